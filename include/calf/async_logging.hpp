@@ -0,0 +1,378 @@
+#ifndef CALF_ASYNC_LOGGING_HPP_
+#define CALF_ASYNC_LOGGING_HPP_
+
+#include "logging.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace calf {
+namespace logging {
+
+// 单个线程独占的日志缓存，单生产者单消费者环形队列。
+// 生产者和消费者的下标分处不同缓存行，线程之间只在队列将满时才会互相访问。
+class log_thread_buffer {
+public:
+  static const std::uint64_t idle = std::numeric_limits<std::uint64_t>::max();
+
+public:
+  explicit log_thread_buffer(std::size_t capacity)
+    : slots_(round_up(capacity)),
+      mask_(slots_.size() - 1),
+      pending_timestamp_(idle),
+      tail_(0),
+      cached_head_(0),
+      head_(0),
+      retired_(false),
+      detached_(false) {}
+
+  // 生产者：写入一条记录，队列满时返回 false。
+  bool push(log_record&& record) {
+    std::size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail - cached_head_ > mask_) {
+        return false;
+      }
+    }
+    slots_[tail & mask_] = std::move(record);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // 消费者：取出当前所有记录，追加到 out 尾部。
+  void drain(std::vector<log_record>& out) {
+    std::size_t head = head_.load(std::memory_order_relaxed);
+    std::size_t tail = tail_.load(std::memory_order_acquire);
+    for (; head != tail; ++head) {
+      out.emplace_back(std::move(slots_[head & mask_]));
+    }
+    head_.store(head, std::memory_order_release);
+  }
+
+  std::size_t size() {
+    return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+  }
+
+  std::size_t capacity() { return slots_.size(); }
+
+  // 正在写入的记录时间戳，空闲时为 idle。消费者据此确定可以安全输出的时间水位。
+  std::atomic<std::uint64_t>& pending_timestamp() { return pending_timestamp_; }
+
+  // 所属线程已经退出。
+  std::atomic_bool& retired() { return retired_; }
+
+  // 所属日志目标已经析构。
+  std::atomic_bool& detached() { return detached_; }
+
+private:
+  static std::size_t round_up(std::size_t n) {
+    std::size_t size = 2;
+    while (size < n) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+private:
+  std::vector<log_record> slots_;
+  std::size_t mask_;
+
+  alignas(64) std::atomic<std::uint64_t> pending_timestamp_;
+  std::atomic<std::size_t> tail_;
+  std::size_t cached_head_;
+
+  alignas(64) std::atomic<std::size_t> head_;
+
+  alignas(64) std::atomic_bool retired_;
+  std::atomic_bool detached_;
+};
+
+struct log_async_options {
+  // 每个线程缓存的记录数。
+  std::size_t buffer_capacity = 4096;
+  // 后台线程最长等待时间。
+  std::chrono::milliseconds flush_interval{10};
+};
+
+// 异步日志输出目标。
+// 每个线程写入自己的缓存，后台线程按时间戳归并所有线程的记录后输出到目标。
+// 结构化记录原样传给目标，编码也在后台线程完成。
+//
+// 输出顺序的保证：写入线程先公布 pending_timestamp，再读取单调时钟作为记录时间戳；
+// 后台线程先读取时钟 W，再读取所有线程的 pending_timestamp，取最小值作为水位。
+// 时间戳小于水位的记录一定已经提交，可以安全输出，其余记录留到下一轮。
+// 传给目标之前记录时间戳才加上墙上时间的偏移，墙上时间回拨不影响顺序。
+class log_async_target
+  : public log_target {
+public:
+  log_async_target(
+      std::unique_ptr<log_target> target,
+      const log_async_options& options = log_async_options())
+    : target_(std::move(target)),
+      options_(options),
+      id_(next_id()),
+      flush_requested_(0),
+      flushed_timestamp_(0),
+      quit_flag_(false),
+      wake_requested_(false) {
+    thread_ = std::thread(&log_async_target::flush_loop, this);
+  }
+
+  ~log_async_target() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    quit_flag_ = true;
+    lock.unlock();
+    cv_.notify_one();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+
+    std::unique_lock<std::mutex> buffers_lock(buffers_mutex_);
+    for (auto& buffer : buffers_) {
+      buffer->detached().store(true, std::memory_order_release);
+    }
+  }
+
+  // 没有调用点信息的记录，按原始文本输出。
+  void output(const log_string& data) override {
+    log_record record;
+    record.message = data;
+    write(std::move(record));
+  }
+
+  void write(log_record&& record) override {
+    log_thread_buffer* buffer = local_buffer();
+    std::atomic<std::uint64_t>& pending = buffer->pending_timestamp();
+    pending.store(now(), std::memory_order_seq_cst);
+    record.timestamp = now();
+
+    while (!buffer->push(std::move(record))) {
+      // 队列满了，唤醒后台线程并让出时间片。
+      wake_requested_.store(true, std::memory_order_release);
+      cv_.notify_one();
+      std::this_thread::yield();
+    }
+    pending.store(log_thread_buffer::idle, std::memory_order_release);
+
+    // 每轮只通知一次，其余写入线程看到标志已经设置就不再调用 notify_one。
+    if (buffer->size() * 2 >= buffer->capacity()
+        && !wake_requested_.exchange(true, std::memory_order_acq_rel)) {
+      cv_.notify_one();
+    }
+  }
+
+  // 等待调用前写入的记录全部输出。
+  void sync() override {
+    std::uint64_t timestamp = now();
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++flush_requested_;
+    cv_.notify_one();
+    flushed_cv_.wait(lock, [this, timestamp]() -> bool {
+      return flushed_timestamp_ > timestamp || quit_flag_;
+    });
+  }
+
+  // 记录时间戳必须在公布 pending_timestamp 之后实时读取，不能使用循环缓存的时间。
+  // 排序使用单调时间，墙上时间会随同步回拨；输出时再统一换算为墙上时间。
+  static std::uint64_t now() {
+    return time::now();
+  }
+
+private:
+  struct run_cursor {
+    std::uint64_t timestamp;
+    std::size_t run;
+    std::size_t index;
+
+    bool operator>(const run_cursor& other) const {
+      return timestamp > other.timestamp;
+    }
+  };
+
+  static std::uint64_t next_id() {
+    static std::atomic<std::uint64_t> id(0);
+    return id.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  // 线程退出时标记它的全部缓存，由后台线程回收。
+  struct local_buffers {
+    ~local_buffers() {
+      for (auto& item : items) {
+        item.second->retired().store(true, std::memory_order_release);
+      }
+    }
+
+    std::vector<std::pair<std::uint64_t, std::shared_ptr<log_thread_buffer>>> items;
+  };
+
+  log_thread_buffer* local_buffer() {
+    thread_local local_buffers buffers;
+    auto& items = buffers.items;
+    for (auto it = items.begin(); it != items.end(); ) {
+      if (it->first == id_) {
+        return it->second.get();
+      }
+      if (it->second->detached().load(std::memory_order_acquire)) {
+        it = items.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    auto buffer = std::make_shared<log_thread_buffer>(options_.buffer_capacity);
+    std::unique_lock<std::mutex> lock(buffers_mutex_);
+    buffers_.push_back(buffer);
+    lock.unlock();
+    items.emplace_back(id_, buffer);
+    return buffer.get();
+  }
+
+  void flush_loop() {
+    std::vector<std::vector<log_record>> runs;
+    std::vector<log_record> held;
+    std::vector<log_record> next_held;
+    std::vector<std::shared_ptr<log_thread_buffer>> buffers;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      cv_.wait_for(lock, options_.flush_interval, [this]() -> bool {
+        return quit_flag_ || flush_requested_ != 0
+            || wake_requested_.load(std::memory_order_acquire);
+      });
+      wake_requested_.store(false, std::memory_order_release);
+      bool quit = quit_flag_;
+      bool sync = flush_requested_ != 0;
+      flush_requested_ = 0;
+      lock.unlock();
+
+      std::unique_lock<std::mutex> buffers_lock(buffers_mutex_);
+      buffers.assign(buffers_.begin(), buffers_.end());
+      buffers_lock.unlock();
+
+      std::uint64_t watermark = quit ? log_thread_buffer::idle : now();
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      for (auto& buffer : buffers) {
+        std::uint64_t pending = buffer->pending_timestamp().load(std::memory_order_seq_cst);
+        if (pending < watermark) {
+          watermark = pending;
+        }
+      }
+
+      runs.resize(buffers.size() + 1);
+      runs[0].swap(held);
+      for (std::size_t i = 0; i < buffers.size(); ++i) {
+        buffers[i]->drain(runs[i + 1]);
+      }
+
+      merge(runs, watermark, next_held);
+      held.swap(next_held);
+      next_held.clear();
+      for (auto& run : runs) {
+        run.clear();
+      }
+      if (sync || quit) {
+        target_->sync();
+      }
+
+      release_retired(buffers);
+      buffers.clear();
+
+      lock.lock();
+      flushed_timestamp_ = watermark;
+      flushed_cv_.notify_all();
+      if (quit) {
+        break;
+      }
+    }
+  }
+
+  // 归并各线程的有序记录，输出时间戳小于水位的部分，其余放回 held。
+  void merge(
+      std::vector<std::vector<log_record>>& runs,
+      std::uint64_t watermark,
+      std::vector<log_record>& held) {
+    std::priority_queue<run_cursor, std::vector<run_cursor>, std::greater<run_cursor>> heap;
+    std::uint64_t realtime_offset = time::tsc_clock::instance()->realtime_offset();
+    for (std::size_t i = 0; i < runs.size(); ++i) {
+      if (!runs[i].empty()) {
+        heap.push({ runs[i][0].timestamp, i, 0 });
+      }
+    }
+
+    while (!heap.empty()) {
+      run_cursor cursor = heap.top();
+      heap.pop();
+      log_record& record = runs[cursor.run][cursor.index];
+      if (record.timestamp < watermark || watermark == log_thread_buffer::idle) {
+        if (record.file == nullptr) {
+          target_->output(record.message);
+        } else {
+          record.timestamp += realtime_offset;
+          target_->write(std::move(record));
+        }
+      } else {
+        held.emplace_back(std::move(record));
+      }
+      if (++cursor.index < runs[cursor.run].size()) {
+        cursor.timestamp = runs[cursor.run][cursor.index].timestamp;
+        heap.push(cursor);
+      }
+    }
+  }
+
+  void release_retired(std::vector<std::shared_ptr<log_thread_buffer>>& buffers) {
+    bool has_retired = false;
+    for (auto& buffer : buffers) {
+      if (buffer->retired().load(std::memory_order_acquire) && buffer->size() == 0) {
+        has_retired = true;
+        break;
+      }
+    }
+    if (!has_retired) {
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(buffers_mutex_);
+    for (auto it = buffers_.begin(); it != buffers_.end(); ) {
+      if ((*it)->retired().load(std::memory_order_acquire) && (*it)->size() == 0) {
+        it = buffers_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+private:
+  std::unique_ptr<log_target> target_;
+  log_async_options options_;
+  std::uint64_t id_;
+
+  std::vector<std::shared_ptr<log_thread_buffer>> buffers_;
+  std::mutex buffers_mutex_;
+
+  std::uint64_t flush_requested_;
+  std::uint64_t flushed_timestamp_;
+  bool quit_flag_;
+  // 写入线程不加锁设置，后台线程每轮开始时清除。错过的通知最多延迟一个 flush_interval。
+  std::atomic_bool wake_requested_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable flushed_cv_;
+  std::thread thread_;
+};
+
+} // namespace logging
+} // namespace calf
+
+#endif // CALF_ASYNC_LOGGING_HPP_
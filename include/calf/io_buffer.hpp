@@ -0,0 +1,615 @@
+// IO 缓存区。
+//
+// pooled_buffer 接口与 std::vector<uint8_t> 相近，区别在于：
+//   - resize 扩大时不初始化新增的内容，读操作之前的 resize 不再清零整块内存；
+//   - 内存按 2 的幂分级，来自线程局部的缓存池，释放后回到当前线程的缓存池，IO 路径上基本没有 malloc/free。
+// 超过最大分级的缓存区直接使用 malloc/free。
+//
+// buffer_chain 是引用计数切片组成的链，待发送的数据按引用挂入，不再拼接成一整块，
+// 发送时用 writev/WSASend 一次提交多个切片，部分写入后从头部消费。
+//
+// aligned_buffer 的地址和容量按指定粒度对齐，用于绕过页缓存的直接 IO。
+//
+#ifndef CALF_IO_BUFFER_HPP_
+#define CALF_IO_BUFFER_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+namespace calf {
+
+class buffer_pool {
+public:
+  // 分级从 256B 到 1MB。
+  static const int min_class_bits = 8;
+  static const int max_class_bits = 20;
+  static const int class_count = max_class_bits - min_class_bits + 1;
+  static const std::size_t min_class_size = std::size_t(1) << min_class_bits;
+  static const std::size_t max_class_size = std::size_t(1) << max_class_bits;
+  // 每个线程每级缓存的字节数上限，小块至少缓存 min_cached_count 个。
+  static const std::size_t max_cached_bytes = 4 * 1024 * 1024;
+  static const std::size_t min_cached_count = 4;
+
+  // 分配至少 capacity 字节，capacity 返回实际可用的大小。
+  static void* allocate(std::size_t& capacity) {
+    int index = get_class(capacity);
+    if (index < 0) {
+      return checked_malloc(capacity);
+    }
+
+    capacity = class_size(index);
+    if (!destroyed()) {
+      std::vector<void*>& list = local().lists[index];
+      if (!list.empty()) {
+        void* p = list.back();
+        list.pop_back();
+        return p;
+      }
+    }
+    return checked_malloc(capacity);
+  }
+
+  static void deallocate(void* p, std::size_t capacity) {
+    if (p == nullptr) {
+      return;
+    }
+    int index = get_class(capacity);
+    if (index < 0 || class_size(index) != capacity || destroyed()) {
+      std::free(p);
+      return;
+    }
+
+    std::vector<void*>& list = local().lists[index];
+    if (list.size() >= max_cached_count(index)) {
+      std::free(p);
+      return;
+    }
+    list.push_back(p);
+  }
+
+  static std::size_t class_size(int index) {
+    return std::size_t(1) << (index + min_class_bits);
+  }
+
+  // 返回分级序号，超过最大分级时返回 -1。
+  static int get_class(std::size_t size) {
+    if (size > max_class_size) {
+      return -1;
+    }
+    int index = 0;
+    while (class_size(index) < size) {
+      ++index;
+    }
+    return index;
+  }
+
+private:
+  struct thread_cache {
+    ~thread_cache() {
+      for (auto& list : lists) {
+        for (void* p : list) {
+          std::free(p);
+        }
+      }
+      destroyed() = true;
+    }
+
+    std::vector<void*> lists[class_count];
+  };
+
+  static std::size_t max_cached_count(int index) {
+    std::size_t count = max_cached_bytes / class_size(index);
+    return count > min_cached_count ? count : min_cached_count;
+  }
+
+  static void* checked_malloc(std::size_t size) {
+    void* p = std::malloc(size);
+    if (p == nullptr) {
+      throw std::bad_alloc();
+    }
+    return p;
+  }
+
+  static thread_cache& local() {
+    thread_local thread_cache cache;
+    return cache;
+  }
+
+  // 线程退出时缓存池可能先于其它线程局部对象析构，之后的释放直接 free。
+  static bool& destroyed() {
+    thread_local bool value = false;
+    return value;
+  }
+};
+
+class pooled_buffer {
+public:
+  using value_type = std::uint8_t;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = value_type&;
+  using const_reference = const value_type&;
+  using pointer = value_type*;
+  using const_pointer = const value_type*;
+  using iterator = value_type*;
+  using const_iterator = const value_type*;
+
+public:
+  pooled_buffer() : data_(nullptr), size_(0), capacity_(0) {}
+
+  // 内容未初始化。
+  explicit pooled_buffer(size_type size) : pooled_buffer() {
+    resize(size);
+  }
+
+  pooled_buffer(size_type size, value_type value) : pooled_buffer() {
+    resize(size, value);
+  }
+
+  pooled_buffer(const_pointer data, size_type size) : pooled_buffer() {
+    append(data, size);
+  }
+
+  pooled_buffer(const pooled_buffer& other) : pooled_buffer() {
+    append(other.data_, other.size_);
+  }
+
+  pooled_buffer(pooled_buffer&& other) noexcept
+    : data_(other.data_), size_(other.size_), capacity_(other.capacity_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.capacity_ = 0;
+  }
+
+  ~pooled_buffer() {
+    buffer_pool::deallocate(data_, capacity_);
+  }
+
+  pooled_buffer& operator=(const pooled_buffer& other) {
+    if (this != &other) {
+      size_ = 0;
+      append(other.data_, other.size_);
+    }
+    return *this;
+  }
+
+  pooled_buffer& operator=(pooled_buffer&& other) noexcept {
+    if (this != &other) {
+      pooled_buffer(std::move(other)).swap(*this);
+    }
+    return *this;
+  }
+
+  pointer data() { return data_; }
+  const_pointer data() const { return data_; }
+  size_type size() const { return size_; }
+  size_type capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+
+  iterator begin() { return data_; }
+  iterator end() { return data_ + size_; }
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+  const_iterator cbegin() const { return data_; }
+  const_iterator cend() const { return data_ + size_; }
+
+  reference operator[](size_type index) { return data_[index]; }
+  const_reference operator[](size_type index) const { return data_[index]; }
+  reference front() { return data_[0]; }
+  reference back() { return data_[size_ - 1]; }
+
+  void reserve(size_type capacity) {
+    if (capacity <= capacity_) {
+      return;
+    }
+    void* p = buffer_pool::allocate(capacity);
+    if (size_ != 0) {
+      std::memcpy(p, data_, size_);
+    }
+    buffer_pool::deallocate(data_, capacity_);
+    data_ = static_cast<pointer>(p);
+    capacity_ = capacity;
+  }
+
+  // 扩大时新增部分不初始化。
+  void resize(size_type size) {
+    if (size > capacity_) {
+      reserve(std::max(size, capacity_ * 2));
+    }
+    size_ = size;
+  }
+
+  void resize(size_type size, value_type value) {
+    size_type old_size = size_;
+    resize(size);
+    if (size > old_size) {
+      std::memset(data_ + old_size, value, size - old_size);
+    }
+  }
+
+  // 保留已分配的内存。
+  void clear() {
+    size_ = 0;
+  }
+
+  // 把内存还给缓存池。
+  void shrink_to_fit() {
+    if (size_ == 0) {
+      buffer_pool::deallocate(data_, capacity_);
+      data_ = nullptr;
+      capacity_ = 0;
+    }
+  }
+
+  void append(const void* data, size_type size) {
+    if (size == 0) {
+      return;
+    }
+    size_type offset = size_;
+    const_pointer source = static_cast<const_pointer>(data);
+    if (source >= data_ && source < data_ + size_) {
+      // 追加自身内容，扩容后按偏移重新定位。
+      size_type source_offset = source - data_;
+      resize(offset + size);
+      std::memcpy(data_ + offset, data_ + source_offset, size);
+      return;
+    }
+    resize(offset + size);
+    std::memcpy(data_ + offset, source, size);
+  }
+
+  void push_back(value_type value) {
+    resize(size_ + 1);
+    data_[size_ - 1] = value;
+  }
+
+  iterator insert(const_iterator pos, const_iterator first, const_iterator last) {
+    size_type offset = pos - data_;
+    size_type count = last - first;
+    if (count == 0) {
+      return data_ + offset;
+    }
+    if (pos == data_ + size_) {
+      append(first, count);
+      return data_ + offset;
+    }
+    // 插入自身内容时先复制一份。
+    pooled_buffer source(first, count);
+    size_type old_size = size_;
+    resize(old_size + count);
+    std::memmove(data_ + offset + count, data_ + offset, old_size - offset);
+    std::memcpy(data_ + offset, source.data_, count);
+    return data_ + offset;
+  }
+
+  iterator erase(const_iterator first, const_iterator last) {
+    size_type offset = first - data_;
+    size_type count = last - first;
+    if (count != 0) {
+      std::memmove(data_ + offset, last, size_ - offset - count);
+      size_ -= count;
+    }
+    return data_ + offset;
+  }
+
+  void swap(pooled_buffer& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+  }
+
+private:
+  pointer data_;
+  size_type size_;
+  size_type capacity_;
+};
+
+inline void swap(pooled_buffer& left, pooled_buffer& right) noexcept {
+  left.swap(right);
+}
+
+// 可以被多个 buffer_chain 共享的缓存区，例如广播给多个连接的同一份数据。
+using shared_buffer = std::shared_ptr<pooled_buffer>;
+
+class buffer_chain {
+public:
+  // 拷贝追加时新建切片的最小长度，小块数据合并到同一个切片里。
+  static const std::size_t min_slice_size = 16 * 1024;
+
+  struct slice {
+    const std::uint8_t* data() const { return buffer->data() + offset; }
+
+    shared_buffer buffer;
+    std::size_t offset;
+    std::size_t size;
+  };
+
+  using const_iterator = std::deque<slice>::const_iterator;
+
+public:
+  buffer_chain() : size_(0) {}
+
+  buffer_chain(buffer_chain&& other) noexcept
+    : slices_(std::move(other.slices_)), size_(other.size_) {
+    other.slices_.clear();
+    other.size_ = 0;
+  }
+
+  buffer_chain& operator=(buffer_chain&& other) noexcept {
+    if (this != &other) {
+      slices_.swap(other.slices_);
+      std::swap(size_, other.size_);
+      other.clear();
+    }
+    return *this;
+  }
+
+  buffer_chain(const buffer_chain&) = delete;
+  buffer_chain& operator=(const buffer_chain&) = delete;
+
+  // 拷贝追加，尾部切片独占且有剩余空间时直接写在后面。
+  void append(const void* data, std::size_t size) {
+    if (size == 0) {
+      return;
+    }
+    if (!slices_.empty()) {
+      slice& tail = slices_.back();
+      pooled_buffer& buffer = *tail.buffer;
+      if (tail.buffer.use_count() == 1 &&
+          tail.offset + tail.size == buffer.size() &&
+          buffer.size() + size <= buffer.capacity()) {
+        buffer.append(data, size);
+        tail.size += size;
+        size_ += size;
+        return;
+      }
+    }
+
+    shared_buffer buffer = std::make_shared<pooled_buffer>();
+    buffer->reserve(size > min_slice_size ? size : min_slice_size);
+    buffer->append(data, size);
+    push_back(std::move(buffer), 0, size);
+  }
+
+  // 按移动接管，不拷贝内容。
+  void append(pooled_buffer&& buffer) {
+    if (buffer.empty()) {
+      return;
+    }
+    std::size_t size = buffer.size();
+    push_back(std::make_shared<pooled_buffer>(std::move(buffer)), 0, size);
+  }
+
+  // 按引用追加，调用者在数据发送完之前不能修改缓存区的内容。
+  void append(const shared_buffer& buffer, std::size_t offset, std::size_t size) {
+    if (size == 0) {
+      return;
+    }
+    push_back(buffer, offset, size);
+  }
+
+  void append(const shared_buffer& buffer) {
+    append(buffer, 0, buffer->size());
+  }
+
+  void append(buffer_chain&& other) {
+    for (auto& item : other.slices_) {
+      slices_.push_back(std::move(item));
+    }
+    size_ += other.size_;
+    other.clear();
+  }
+
+  // 从头部移除已经写出的 bytes 字节。
+  void consume(std::size_t bytes) {
+    if (bytes >= size_) {
+      clear();
+      return;
+    }
+    size_ -= bytes;
+    while (bytes > 0) {
+      slice& head = slices_.front();
+      if (bytes < head.size) {
+        head.offset += bytes;
+        head.size -= bytes;
+        break;
+      }
+      bytes -= head.size;
+      slices_.pop_front();
+    }
+  }
+
+  void clear() {
+    slices_.clear();
+    size_ = 0;
+  }
+
+  void swap(buffer_chain& other) noexcept {
+    slices_.swap(other.slices_);
+    std::swap(size_, other.size_);
+  }
+
+  // 总字节数。
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  std::size_t slice_count() const { return slices_.size(); }
+
+  const_iterator begin() const { return slices_.begin(); }
+  const_iterator end() const { return slices_.end(); }
+
+private:
+  void push_back(shared_buffer buffer, std::size_t offset, std::size_t size) {
+    slice item;
+    item.buffer = std::move(buffer);
+    item.offset = offset;
+    item.size = size;
+    slices_.push_back(std::move(item));
+    size_ += size;
+  }
+
+private:
+  std::deque<slice> slices_;
+  std::size_t size_;
+};
+
+// 按 alignment 对齐的缓存区，alignment 必须是 2 的幂。
+// 容量总是 alignment 的整数倍，直接 IO 可以读写到 aligned_size() 为止，尾部多出的部分由调用者决定内容。
+class aligned_buffer {
+public:
+  using value_type = std::uint8_t;
+  using size_type = std::size_t;
+  using pointer = value_type*;
+  using const_pointer = const value_type*;
+
+  // 常见设备的逻辑块为 512B 或 4KB，按 4KB 对齐同时满足两者。
+  static const size_type default_alignment = 4096;
+
+public:
+  explicit aligned_buffer(size_type alignment = default_alignment)
+    : data_(nullptr), size_(0), capacity_(0), alignment_(alignment) {}
+
+  // 内容未初始化。
+  aligned_buffer(size_type size, size_type alignment)
+    : aligned_buffer(alignment) {
+    resize(size);
+  }
+
+  aligned_buffer(aligned_buffer&& other) noexcept
+    : data_(other.data_),
+      size_(other.size_),
+      capacity_(other.capacity_),
+      alignment_(other.alignment_) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.capacity_ = 0;
+  }
+
+  aligned_buffer& operator=(aligned_buffer&& other) noexcept {
+    if (this != &other) {
+      aligned_buffer(std::move(other)).swap(*this);
+    }
+    return *this;
+  }
+
+  aligned_buffer(const aligned_buffer&) = delete;
+  aligned_buffer& operator=(const aligned_buffer&) = delete;
+
+  ~aligned_buffer() {
+    free_aligned(data_);
+  }
+
+  pointer data() { return data_; }
+  const_pointer data() const { return data_; }
+  size_type size() const { return size_; }
+  size_type capacity() const { return capacity_; }
+  size_type alignment() const { return alignment_; }
+  bool empty() const { return size_ == 0; }
+
+  // 向上对齐后的长度，不超过容量。
+  size_type aligned_size() const { return align_up(size_, alignment_); }
+
+  value_type& operator[](size_type index) { return data_[index]; }
+  const value_type& operator[](size_type index) const { return data_[index]; }
+
+  void reserve(size_type capacity) {
+    capacity = align_up(capacity, alignment_);
+    if (capacity <= capacity_) {
+      return;
+    }
+    pointer p = static_cast<pointer>(allocate_aligned(capacity, alignment_));
+    if (size_ != 0) {
+      std::memcpy(p, data_, size_);
+    }
+    free_aligned(data_);
+    data_ = p;
+    capacity_ = capacity;
+  }
+
+  // 扩大时新增部分不初始化。
+  void resize(size_type size) {
+    if (size > capacity_) {
+      reserve(std::max(size, capacity_ * 2));
+    }
+    size_ = size;
+  }
+
+  void append(const void* data, size_type size) {
+    size_type offset = size_;
+    resize(offset + size);
+    std::memcpy(data_ + offset, data, size);
+  }
+
+  // 把 size 到 aligned_size 之间的尾部填零，写入不足一块的尾部之前调用。
+  void zero_tail() {
+    if (data_ != nullptr) {
+      std::memset(data_ + size_, 0, aligned_size() - size_);
+    }
+  }
+
+  void clear() {
+    size_ = 0;
+  }
+
+  void swap(aligned_buffer& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(alignment_, other.alignment_);
+  }
+
+  static size_type align_up(size_type value, size_type alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+  }
+
+  static size_type align_down(size_type value, size_type alignment) {
+    return value & ~(alignment - 1);
+  }
+
+  static bool is_aligned(const void* p, size_type alignment) {
+    return (reinterpret_cast<std::uintptr_t>(p) & (alignment - 1)) == 0;
+  }
+
+  static void* allocate_aligned(size_type size, size_type alignment) {
+#if defined(_MSC_VER)
+    void* p = _aligned_malloc(size, alignment);
+#else
+    void* p = nullptr;
+    if (::posix_memalign(&p, alignment, size) != 0) {
+      p = nullptr;
+    }
+#endif
+    if (p == nullptr) {
+      throw std::bad_alloc();
+    }
+    return p;
+  }
+
+  static void free_aligned(void* p) {
+#if defined(_MSC_VER)
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+  }
+
+private:
+  pointer data_;
+  size_type size_;
+  size_type capacity_;
+  size_type alignment_;
+};
+
+} // namespace calf
+
+#endif // CALF_IO_BUFFER_HPP_
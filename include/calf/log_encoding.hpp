@@ -0,0 +1,435 @@
+// 结构化日志编码。
+//
+// 把 log_record 编码为 UTF-8 字节流，支持文本、logfmt、JSON lines 和二进制格式。
+// JSON 字符串转义在支持 SSE2 的平台上每次扫描 16 字节。
+//
+#ifndef CALF_LOG_ENCODING_HPP_
+#define CALF_LOG_ENCODING_HPP_
+
+#include "logging.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CALF_LOG_ENCODING_SSE2 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace calf {
+namespace logging {
+
+namespace detail {
+
+inline bool json_needs_escape(unsigned char c) {
+  return c < 0x20 || c == '"' || c == '\\';
+}
+
+inline void append_json_escape_char(std::string& out, unsigned char c) {
+  static const char hex[] = "0123456789abcdef";
+  switch (c) {
+  case '"':
+    out.append("\\\"");
+    break;
+  case '\\':
+    out.append("\\\\");
+    break;
+  case '\b':
+    out.append("\\b");
+    break;
+  case '\f':
+    out.append("\\f");
+    break;
+  case '\n':
+    out.append("\\n");
+    break;
+  case '\r':
+    out.append("\\r");
+    break;
+  case '\t':
+    out.append("\\t");
+    break;
+  default: {
+    char buf[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f] };
+    out.append(buf, sizeof(buf));
+    break;
+  }
+  }
+}
+
+#ifdef CALF_LOG_ENCODING_SSE2
+inline int count_trailing_zeros(unsigned int mask) {
+#if defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+} // namespace detail
+
+// JSON 字符串转义，输入为 UTF-8，非 ASCII 字节原样输出。
+inline void append_json_escaped(std::string& out, const char* data, std::size_t size) {
+  out.reserve(out.size() + size + 2);
+  std::size_t i = 0;
+
+#ifdef CALF_LOG_ENCODING_SSE2
+  // 一次比较 16 字节：'"'、'\\' 以及小于 0x20 的控制字符。
+  // 无符号比较 c <= 0x1f 等价于 min(c, 0x1f) == c。
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i control = _mm_set1_epi8(0x1f);
+  while (i + 16 <= size) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+    unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(special));
+    if (mask == 0) {
+      out.append(data + i, 16);
+      i += 16;
+      continue;
+    }
+    std::size_t clean = static_cast<std::size_t>(detail::count_trailing_zeros(mask));
+    out.append(data + i, clean);
+    i += clean;
+    detail::append_json_escape_char(out, static_cast<unsigned char>(data[i]));
+    ++i;
+  }
+#endif
+
+  while (i < size) {
+    std::size_t begin = i;
+    while (i < size && !detail::json_needs_escape(static_cast<unsigned char>(data[i]))) {
+      ++i;
+    }
+    out.append(data + begin, i - begin);
+    if (i < size) {
+      detail::append_json_escape_char(out, static_cast<unsigned char>(data[i]));
+      ++i;
+    }
+  }
+}
+
+inline void append_json_escaped(std::string& out, const std::string& str) {
+  append_json_escaped(out, str.data(), str.size());
+}
+
+inline const char* get_level_name(log_level level) {
+  switch (level)
+  {
+  case log_level::verbose:
+    return "verbose";
+  case log_level::info:
+    return "info";
+  case log_level::warn:
+    return "warn";
+  case log_level::error:
+    return "error";
+  case log_level::fatal:
+    return "fatal";
+  default:
+    return "unknown";
+  }
+}
+
+namespace detail {
+
+inline void append_number(std::string& out, std::int64_t value) {
+  char buf[24];
+  int n = std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(value));
+  out.append(buf, n);
+}
+
+inline void append_number(std::string& out, std::uint64_t value) {
+  char buf[24];
+  int n = std::snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(value));
+  out.append(buf, n);
+}
+
+inline void append_number(std::string& out, double value) {
+  char buf[32];
+  int n = std::snprintf(buf, sizeof(buf), "%.17g", value);
+  out.append(buf, n);
+}
+
+// 标量字段直接输出文本，字符串字段交给 escape 处理。
+template<typename Escape>
+void append_field_value(std::string& out, const log_field& field, Escape escape) {
+  switch (field.type) {
+  case log_value_type::boolean:
+    out.append(field.boolean ? "true" : "false");
+    break;
+  case log_value_type::int64:
+    append_number(out, field.int64);
+    break;
+  case log_value_type::uint64:
+    append_number(out, field.uint64);
+    break;
+  case log_value_type::float64:
+    append_number(out, field.float64);
+    break;
+  case log_value_type::string:
+    escape(out, field.str);
+    break;
+  case log_value_type::wstring: {
+    std::string str;
+    append_utf8(str, field.wstr);
+    escape(out, str);
+    break;
+  }
+  }
+}
+
+inline bool logfmt_needs_quote(const std::string& str) {
+  if (str.empty()) {
+    return true;
+  }
+  for (char c : str) {
+    if (c == ' ' || c == '=' || c == '"' || static_cast<unsigned char>(c) < 0x20) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline void append_logfmt_value(std::string& out, const std::string& str) {
+  if (!logfmt_needs_quote(str)) {
+    out.append(str);
+    return;
+  }
+  out.push_back('"');
+  append_json_escaped(out, str);
+  out.push_back('"');
+}
+
+inline void append_json_string(std::string& out, const std::string& str) {
+  out.push_back('"');
+  append_json_escaped(out, str);
+  out.push_back('"');
+}
+
+// JSON 不能表示 NaN 和无穷大，输出 null。
+inline void append_json_field_value(std::string& out, const log_field& field) {
+  if (field.type == log_value_type::float64 && !std::isfinite(field.float64)) {
+    out.append("null");
+    return;
+  }
+  append_field_value(out, field, append_json_string);
+}
+
+template<typename T>
+void put_binary(std::string& out, T value) {
+  char buf[sizeof(T)];
+  std::memcpy(buf, &value, sizeof(T));
+  out.append(buf, sizeof(T));
+}
+
+inline void put_binary_string(std::string& out, const char* data, std::size_t size) {
+  put_binary<std::uint32_t>(out, static_cast<std::uint32_t>(size));
+  out.append(data, size);
+}
+
+} // namespace detail
+
+// 文本格式，与 format_text 一致。
+inline void encode_text(const log_record& record, std::string& out) {
+  if (record.timestamp != 0) {
+    char buf[32];
+    std::size_t length = format_log_time(record.timestamp, buf);
+    out.push_back('[');
+    out.append(buf, length);
+    out.push_back(']');
+  }
+  out.append("[CALF ");
+  if (record.target_name != nullptr) {
+    for (const char* p = record.target_name; *p != '\0'; ++p) {
+      out.push_back(static_cast<char>(::toupper(static_cast<unsigned char>(*p))));
+    }
+    out.push_back(' ');
+  }
+  out.append(get_level_string(record.level));
+  out.append("][");
+  if (record.file != nullptr) {
+    append_utf8(out, record.file, std::char_traits<log_char>::length(record.file));
+  }
+  out.push_back('(');
+  detail::append_number(out, static_cast<std::int64_t>(record.line));
+  out.append(")] ");
+  append_utf8(out, record.message);
+  for (auto& field : record.fields) {
+    out.push_back(' ');
+    append_log_key(out, field.key);
+    out.push_back('=');
+    detail::append_field_value(out, field, [](std::string& o, const std::string& s) {
+      o.append(s);
+    });
+  }
+  out.push_back('\n');
+}
+
+// logfmt：ts=... level=info target=... file=... line=... msg="..." key=value
+inline void encode_logfmt(const log_record& record, std::string& out) {
+  if (record.timestamp != 0) {
+    out.append("ts=");
+    detail::append_number(out, record.timestamp);
+    out.push_back(' ');
+  }
+  out.append("level=");
+  out.append(get_level_name(record.level));
+  if (record.target_name != nullptr) {
+    out.append(" target=");
+    out.append(record.target_name);
+  }
+  if (record.file != nullptr) {
+    std::string file;
+    append_utf8(file, record.file, std::char_traits<log_char>::length(record.file));
+    out.append(" file=");
+    detail::append_logfmt_value(out, file);
+    out.append(" line=");
+    detail::append_number(out, static_cast<std::int64_t>(record.line));
+  }
+  std::string message;
+  append_utf8(message, record.message);
+  out.append(" msg=");
+  detail::append_logfmt_value(out, message);
+  for (auto& field : record.fields) {
+    out.push_back(' ');
+    append_log_key(out, field.key);
+    out.push_back('=');
+    detail::append_field_value(out, field, detail::append_logfmt_value);
+  }
+  out.push_back('\n');
+}
+
+// JSON lines，每条记录一个 JSON 对象。
+inline void encode_json(const log_record& record, std::string& out) {
+  out.push_back('{');
+  if (record.timestamp != 0) {
+    out.append("\"ts\":");
+    detail::append_number(out, record.timestamp);
+    out.push_back(',');
+  }
+  out.append("\"level\":\"");
+  out.append(get_level_name(record.level));
+  out.push_back('"');
+  if (record.target_name != nullptr) {
+    out.append(",\"target\":");
+    detail::append_json_string(out, record.target_name);
+  }
+  if (record.file != nullptr) {
+    std::string file;
+    append_utf8(file, record.file, std::char_traits<log_char>::length(record.file));
+    out.append(",\"file\":");
+    detail::append_json_string(out, file);
+    out.append(",\"line\":");
+    detail::append_number(out, static_cast<std::int64_t>(record.line));
+  }
+  std::string message;
+  append_utf8(message, record.message);
+  out.append(",\"msg\":");
+  detail::append_json_string(out, message);
+  for (auto& field : record.fields) {
+    out.push_back(',');
+    detail::append_json_string(out, field.key);
+    out.push_back(':');
+    detail::append_json_field_value(out, field);
+  }
+  out.append("}\n");
+}
+
+// 二进制格式，主机字节序：
+//   u32 记录长度（不含本字段） u8 版本 u8 级别 u64 时间戳 u32 行号
+//   str 目标 str 文件 str 消息 u16 字段数
+//   每个字段：str 键 u8 类型 值（数值 8 字节，字符串为 str）
+// 其中 str 为 u32 长度加 UTF-8 字节。
+static const std::uint8_t log_binary_version = 1;
+
+inline void encode_binary(const log_record& record, std::string& out) {
+  std::size_t start = out.size();
+  detail::put_binary<std::uint32_t>(out, 0);
+  detail::put_binary<std::uint8_t>(out, log_binary_version);
+  detail::put_binary<std::uint8_t>(out, static_cast<std::uint8_t>(record.level));
+  detail::put_binary<std::uint64_t>(out, record.timestamp);
+  detail::put_binary<std::uint32_t>(out, static_cast<std::uint32_t>(record.line));
+
+  const char* target = record.target_name != nullptr ? record.target_name : "";
+  detail::put_binary_string(out, target, std::strlen(target));
+
+  std::string str;
+  if (record.file != nullptr) {
+    append_utf8(str, record.file, std::char_traits<log_char>::length(record.file));
+  }
+  detail::put_binary_string(out, str.data(), str.size());
+  str.clear();
+  append_utf8(str, record.message);
+  detail::put_binary_string(out, str.data(), str.size());
+
+  detail::put_binary<std::uint16_t>(out, static_cast<std::uint16_t>(record.fields.size()));
+  for (auto& field : record.fields) {
+    detail::put_binary_string(out, field.key.data(), field.key.size());
+    switch (field.type) {
+    case log_value_type::boolean:
+      detail::put_binary<std::uint8_t>(out, static_cast<std::uint8_t>(field.type));
+      detail::put_binary<std::uint64_t>(out, field.boolean ? 1 : 0);
+      break;
+    case log_value_type::int64:
+      detail::put_binary<std::uint8_t>(out, static_cast<std::uint8_t>(field.type));
+      detail::put_binary<std::int64_t>(out, field.int64);
+      break;
+    case log_value_type::uint64:
+      detail::put_binary<std::uint8_t>(out, static_cast<std::uint8_t>(field.type));
+      detail::put_binary<std::uint64_t>(out, field.uint64);
+      break;
+    case log_value_type::float64:
+      detail::put_binary<std::uint8_t>(out, static_cast<std::uint8_t>(field.type));
+      detail::put_binary<double>(out, field.float64);
+      break;
+    case log_value_type::string:
+      detail::put_binary<std::uint8_t>(out, static_cast<std::uint8_t>(log_value_type::string));
+      detail::put_binary_string(out, field.str.data(), field.str.size());
+      break;
+    case log_value_type::wstring:
+      // 宽字符串统一编码为 UTF-8 字符串。
+      str.clear();
+      append_utf8(str, field.wstr);
+      detail::put_binary<std::uint8_t>(out, static_cast<std::uint8_t>(log_value_type::string));
+      detail::put_binary_string(out, str.data(), str.size());
+      break;
+    }
+  }
+
+  std::uint32_t length = static_cast<std::uint32_t>(out.size() - start - sizeof(std::uint32_t));
+  std::memcpy(&out[start], &length, sizeof(length));
+}
+
+inline void encode(const log_record& record, log_format format, std::string& out) {
+  switch (format) {
+  case log_format::text:
+    encode_text(record, out);
+    break;
+  case log_format::logfmt:
+    encode_logfmt(record, out);
+    break;
+  case log_format::json:
+    encode_json(record, out);
+    break;
+  case log_format::binary:
+    encode_binary(record, out);
+    break;
+  }
+}
+
+} // namespace logging
+} // namespace calf
+
+#endif // CALF_LOG_ENCODING_HPP_
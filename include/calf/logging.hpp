@@ -2,6 +2,7 @@
 #define CALF_LOGGING_HPP_
 
 #include "singleton.hpp"
+#include "time.hpp"
 
 #include <sstream>
 #include <string>
@@ -11,6 +12,15 @@
 #include <memory>
 #include <cctype>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace calf {
 namespace logging {
@@ -23,41 +33,513 @@ enum class log_level {
   fatal
 };
 
+// 日志字符类型策略。
+// Windows 默认使用宽字符，其它平台默认使用 UTF-8 字节，
+// 定义 CALF_LOG_WCHAR 或 CALF_LOG_UTF8 可以强制选择。
+template<typename CharT>
+struct log_char_policy {
+  using char_type = CharT;
+  using string_type = std::basic_string<CharT>;
+  using stream_type = std::basic_ostringstream<CharT>;
+};
+
+#if defined(CALF_LOG_WCHAR) || (defined(_WIN32) && !defined(CALF_LOG_UTF8))
+#define CALF_LOG_WIDE_CHAR 1
+using log_policy = log_char_policy<wchar_t>;
+#else
+using log_policy = log_char_policy<char>;
+#endif
+
+using log_char = log_policy::char_type;
+using log_string = log_policy::string_type;
+using log_stream = log_policy::stream_type;
+
+// 宽字符串转 UTF-8，wchar_t 为 2 字节时按 UTF-16 处理代理对。
+inline void append_utf8(std::string& out, const wchar_t* str, std::size_t length) {
+  out.reserve(out.size() + length);
+  for (std::size_t i = 0; i < length; ++i) {
+    std::uint32_t cp = static_cast<std::uint32_t>(str[i]);
+    if (sizeof(wchar_t) == 2) {
+      cp &= 0xffff;
+      if (cp >= 0xd800 && cp < 0xdc00 && i + 1 < length) {
+        std::uint32_t low = static_cast<std::uint32_t>(str[i + 1]) & 0xffff;
+        if (low >= 0xdc00 && low < 0xe000) {
+          cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+          ++i;
+        }
+      }
+    }
+
+    if (cp < 0x80) {
+      out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+      out.push_back(static_cast<char>(0xc0 | (cp >> 6)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x10000) {
+      out.push_back(static_cast<char>(0xe0 | (cp >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else if (cp < 0x110000) {
+      out.push_back(static_cast<char>(0xf0 | (cp >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3f)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3f)));
+    } else {
+      out.append("\xef\xbf\xbd");  // U+FFFD
+    }
+  }
+}
+
+// 已经是 UTF-8，直接追加。
+inline void append_utf8(std::string& out, const char* str, std::size_t length) {
+  out.append(str, length);
+}
+
+template<typename CharT>
+void append_utf8(std::string& out, const std::basic_string<CharT>& str) {
+  append_utf8(out, str.data(), str.size());
+}
+
+// UTF-8 转宽字符串，wchar_t 为 2 字节时生成代理对。
+inline void append_wide(std::wstring& out, const char* str, std::size_t length) {
+  out.reserve(out.size() + length);
+  std::size_t i = 0;
+  while (i < length) {
+    std::uint8_t c = static_cast<std::uint8_t>(str[i++]);
+    std::size_t extra = 0;
+    std::uint32_t cp = c;
+    if (c >= 0xf0 && c < 0xf8) {
+      cp = c & 0x07;
+      extra = 3;
+    } else if (c >= 0xe0 && c < 0xf0) {
+      cp = c & 0x0f;
+      extra = 2;
+    } else if (c >= 0xc0 && c < 0xe0) {
+      cp = c & 0x1f;
+      extra = 1;
+    } else if (c >= 0x80) {
+      cp = 0xfffd;
+    }
+    for (; extra > 0; --extra, ++i) {
+      if (i >= length || (static_cast<std::uint8_t>(str[i]) & 0xc0) != 0x80) {
+        cp = 0xfffd;
+        break;
+      }
+      cp = (cp << 6) | (static_cast<std::uint8_t>(str[i]) & 0x3f);
+    }
+    if (sizeof(wchar_t) == 2 && cp >= 0x10000) {
+      cp -= 0x10000;
+      out.push_back(static_cast<wchar_t>(0xd800 + (cp >> 10)));
+      out.push_back(static_cast<wchar_t>(0xdc00 + (cp & 0x3ff)));
+    } else {
+      out.push_back(static_cast<wchar_t>(cp));
+    }
+  }
+}
+
+// 追加到日志字符串，字符类型不同时才转换。
+inline void append_log_string(std::string& out, const char* str, std::size_t length) {
+  out.append(str, length);
+}
+
+inline void append_log_string(std::string& out, const wchar_t* str, std::size_t length) {
+  append_utf8(out, str, length);
+}
+
+inline void append_log_string(std::wstring& out, const char* str, std::size_t length) {
+  append_wide(out, str, length);
+}
+
+inline void append_log_string(std::wstring& out, const wchar_t* str, std::size_t length) {
+  out.append(str, length);
+}
+
+// 日志编码格式，由输出目标决定。
+enum class log_format {
+  text,
+  logfmt,
+  json,
+  binary
+};
+
+enum class log_value_type : std::uint8_t {
+  boolean,
+  int64,
+  uint64,
+  float64,
+  string,
+  wstring
+};
+
+// 结构化字段，保留原始类型，直到输出目标编码时才格式化。
+struct log_field {
+  log_field(std::string field_key, bool value)
+    : key(std::move(field_key)), type(log_value_type::boolean), uint64(0) {
+    boolean = value;
+  }
+
+  template<typename T, typename std::enable_if<
+      std::is_integral<T>::value && std::is_signed<T>::value, int>::type = 0>
+  log_field(std::string field_key, T value)
+    : key(std::move(field_key)), type(log_value_type::int64), int64(value) {}
+
+  template<typename T, typename std::enable_if<
+      std::is_integral<T>::value && std::is_unsigned<T>::value &&
+      !std::is_same<T, bool>::value, int>::type = 0>
+  log_field(std::string field_key, T value)
+    : key(std::move(field_key)), type(log_value_type::uint64), uint64(value) {}
+
+  template<typename T, typename std::enable_if<
+      std::is_floating_point<T>::value, int>::type = 0>
+  log_field(std::string field_key, T value)
+    : key(std::move(field_key)), type(log_value_type::float64), float64(value) {}
+
+  log_field(std::string field_key, const char* value)
+    : key(std::move(field_key)), type(log_value_type::string), uint64(0),
+      str(value != nullptr ? value : "") {}
+
+  log_field(std::string field_key, std::string value)
+    : key(std::move(field_key)), type(log_value_type::string), uint64(0),
+      str(std::move(value)) {}
+
+  log_field(std::string field_key, const wchar_t* value)
+    : key(std::move(field_key)), type(log_value_type::wstring), uint64(0),
+      wstr(value != nullptr ? value : L"") {}
+
+  log_field(std::string field_key, std::wstring value)
+    : key(std::move(field_key)), type(log_value_type::wstring), uint64(0),
+      wstr(std::move(value)) {}
+
+  std::string key;
+  log_value_type type;
+  union {
+    bool boolean;
+    std::int64_t int64;
+    std::uint64_t uint64;
+    double float64;
+  };
+  std::string str;
+  std::wstring wstr;
+};
+
+struct log_record {
+  log_record()
+    : level(log_level::info),
+      target_name(nullptr),
+      file(nullptr),
+      line(0),
+      timestamp(0) {}
+
+  log_level level;
+  const char* target_name;
+  const log_char* file;
+  int line;
+  std::uint64_t timestamp;
+  log_string message;
+  std::vector<log_field> fields;
+};
+
+// 文本和 logfmt 格式的字段名。包含空格、'='、引号、反斜杠或控制字符时加引号并转义，
+// 避免与分隔符混淆，普通的字段名原样输出。
+inline void append_log_key(std::string& out, const std::string& key) {
+  bool quote = key.empty();
+  for (char c : key) {
+    if (static_cast<unsigned char>(c) <= 0x20 || c == '=' || c == '"' || c == '\\') {
+      quote = true;
+      break;
+    }
+  }
+  if (!quote) {
+    out.append(key);
+    return;
+  }
+  static const char hex[] = "0123456789abcdef";
+  out.push_back('"');
+  for (char c : key) {
+    unsigned char u = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (u < 0x20) {
+      char buf[6] = { '\\', 'u', '0', '0', hex[u >> 4], hex[u & 0x0f] };
+      out.append(buf, sizeof(buf));
+    } else {
+      out.push_back(c);
+    }
+  }
+  out.push_back('"');
+}
+
+inline const char* get_level_string(log_level level) {
+  switch (level)
+  {
+  case log_level::verbose:
+    return "VERBOSE";
+  case log_level::info:
+    return "INFO";
+  case log_level::warn:
+    return "WARN";
+  case log_level::error:
+    return "ERROR";
+  case log_level::fatal:
+    return "FATAL";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+// 格式化时间戳为 "YYYY-mm-dd HH:MM:SS.uuuuuu"，返回长度。buf 至少 32 字节。
+// 同一秒内的日期部分按线程缓存，避免每条日志都调用 localtime。
+inline std::size_t format_log_time(std::uint64_t timestamp, char* buf) {
+  thread_local std::time_t cached_seconds = -1;
+  thread_local char cached[24] = { 0 };
+
+  std::time_t seconds = static_cast<std::time_t>(timestamp / 1000000000ull);
+  if (seconds != cached_seconds) {
+    std::tm tm_now;
+#if defined(_WIN32)
+    ::localtime_s(&tm_now, &seconds);
+#else
+    ::localtime_r(&seconds, &tm_now);
+#endif
+    std::strftime(cached, sizeof(cached), "%Y-%m-%d %H:%M:%S", &tm_now);
+    cached_seconds = seconds;
+  }
+
+  std::size_t length = std::strlen(cached);
+  std::memcpy(buf, cached, length);
+  unsigned int micros = static_cast<unsigned int>((timestamp / 1000) % 1000000);
+  length += std::snprintf(buf + length, 8, ".%06u", micros);
+  return length;
+}
+
+// 默认文本格式：[time][CALF TARGET LEVEL][file(line)] message key=value
+// 固定文本都是 ASCII，可以直接写入任意字符类型的流。
+inline log_string format_text(const log_record& record) {
+  log_stream stream;
+  if (record.timestamp != 0) {
+    char buf[32];
+    std::size_t length = format_log_time(record.timestamp, buf);
+    buf[length] = '\0';
+    stream << "[" << buf << "]";
+  }
+  stream << "[CALF ";
+  if (record.target_name != nullptr) {
+    for (const char* p = record.target_name; *p != '\0'; ++p) {
+      stream << static_cast<char>(::toupper(static_cast<unsigned char>(*p)));
+    }
+    stream << " ";
+  }
+  stream << get_level_string(record.level) << "][";
+  if (record.file != nullptr) {
+    stream << record.file;
+  }
+  stream << "(" << record.line << ")] " << record.message;
+  log_string text;
+  std::string key;
+  for (auto& field : record.fields) {
+    key.clear();
+    append_log_key(key, field.key);
+    text.clear();
+    append_log_string(text, key.data(), key.size());
+    stream << " " << text << "=";
+    switch (field.type) {
+    case log_value_type::boolean:
+      stream << (field.boolean ? "true" : "false");
+      break;
+    case log_value_type::int64:
+      stream << field.int64;
+      break;
+    case log_value_type::uint64:
+      stream << field.uint64;
+      break;
+    case log_value_type::float64:
+      stream << field.float64;
+      break;
+    case log_value_type::string:
+      text.clear();
+      append_log_string(text, field.str.data(), field.str.size());
+      stream << text;
+      break;
+    case log_value_type::wstring:
+      text.clear();
+      append_log_string(text, field.wstr.data(), field.wstr.size());
+      stream << text;
+      break;
+    }
+  }
+  stream << std::endl;
+  return stream.str();
+}
+
 class log_target {
 public:
   virtual ~log_target() {}
 
-  virtual void output(const std::wstring& data) = 0;
+  virtual void output(const log_string& data) = 0;
+
+  // 结构化记录，默认按文本格式输出。需要其它编码格式的目标可以重写。
+  virtual void write(log_record&& record) {
+    output(format_text(record));
+  }
+
   virtual void sync() {}
 };
 
+// 与日志字符类型匹配的标准输出流。
+template<typename CharT>
+struct log_console;
+
+template<>
+struct log_console<char> {
+  static std::ostream& out() { return std::cout; }
+  static std::ostream& err() { return std::cerr; }
+};
+
+template<>
+struct log_console<wchar_t> {
+  static std::wostream& out() { return std::wcout; }
+  static std::wostream& err() { return std::wcerr; }
+};
+
 class log_stderr_target
   : public log_target {
 public:
-  void output(const std::wstring& data) override {
-    std::wcerr << data;
+  void output(const log_string& data) override {
+    log_console<log_char>::err() << data;
   }
 
   void sync() override {
-    std::wcerr.flush();
+    log_console<log_char>::err().flush();
   }
 };
 
 class log_stdout_target 
   : public log_target {
 public:
-  void output(const std::wstring& data) override {
-    std::wcout << data;
+  void output(const log_string& data) override {
+    log_console<log_char>::out() << data;
   }
 
   void sync() override {
-    std::wcout.flush();
+    log_console<log_char>::out().flush();
   }
 };
 
+// 调用点在窗口内第一次抑制时安排一次汇总，定义在 log_manager 之后。
+inline void schedule_suppressed_report();
+
+// 调用点限流器基类，统计被抑制的日志条数。
+class log_site_limiter {
+public:
+  log_site_limiter(const char* target_name, log_level level, const log_char* file, int line)
+    : target_name_(target_name),
+      level_(level),
+      file_(file),
+      line_(line),
+      suppressed_(0) {}
+  virtual ~log_site_limiter() {}
+
+  // 取出并清零被抑制的条数。
+  std::uint64_t take_suppressed() {
+    if (suppressed_.load(std::memory_order_relaxed) == 0) {
+      return 0;
+    }
+    return suppressed_.exchange(0, std::memory_order_relaxed);
+  }
+
+  const char* target_name() const { return target_name_; }
+  log_level level() const { return level_; }
+  const log_char* file() const { return file_; }
+  int line() const { return line_; }
+
+protected:
+  void suppress() {
+    if (suppressed_.fetch_add(1, std::memory_order_relaxed) == 0) {
+      schedule_suppressed_report();
+    }
+  }
+
+private:
+  const char* target_name_;
+  log_level level_;
+  const log_char* file_;
+  int line_;
+  std::atomic<std::uint64_t> suppressed_;
+};
+
+// 令牌桶限流，每秒最多 rate 条，允许 burst 条突发。
+// 使用 GCRA 算法，只需维护一个理论到达时间，一次 CAS 即可完成检查，无锁。
+class log_rate_limiter
+  : public log_site_limiter {
+public:
+  log_rate_limiter(
+      double rate,
+      std::uint64_t burst,
+      const char* target_name,
+      log_level level,
+      const log_char* file,
+      int line)
+    : log_site_limiter(target_name, level, file, line),
+      interval_(static_cast<std::int64_t>(1e9 / (rate > 0 ? rate : 1e-9))),
+      tolerance_(interval_ * static_cast<std::int64_t>(burst > 0 ? burst : 1)),
+      arrival_(0) {}
+
+  bool allow() {
+    std::int64_t now = static_cast<std::int64_t>(time::cached_now());
+    std::int64_t arrival = arrival_.load(std::memory_order_relaxed);
+    for (;;) {
+      std::int64_t next = std::max(arrival, now) + interval_;
+      if (next - now > tolerance_) {
+        suppress();
+        return false;
+      }
+      if (arrival_.compare_exchange_weak(arrival, next, std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+  }
+
+private:
+  std::int64_t interval_;
+  std::int64_t tolerance_;
+  std::atomic<std::int64_t> arrival_;
+};
+
+// 采样，每 k 条输出 1 条。
+class log_sampler
+  : public log_site_limiter {
+public:
+  log_sampler(
+      std::uint64_t k,
+      const char* target_name,
+      log_level level,
+      const log_char* file,
+      int line)
+    : log_site_limiter(target_name, level, file, line),
+      k_(k > 0 ? k : 1),
+      count_(0) {}
+
+  bool allow() {
+    if (count_.fetch_add(1, std::memory_order_relaxed) % k_ == 0) {
+      return true;
+    }
+    suppress();
+    return false;
+  }
+
+private:
+  std::uint64_t k_;
+  std::atomic<std::uint64_t> count_;
+};
+
 class log_manager : public singleton<log_manager> {
 public:
-  log_manager() : default_target_("stdout") {
+  // 被抑制条数的汇总窗口。
+  static const std::uint64_t suppressed_window_ns = 1000000000;
+
+public:
+  log_manager() : default_target_("stdout"), report_at_(0) {
     std::unique_lock<std::mutex> lock(mutex_);
     targets_.emplace("stdout", std::make_unique<log_stdout_target>());
     targets_.emplace("stderr", std::make_unique<log_stderr_target>());
@@ -90,33 +572,67 @@ public:
     default_target_ = name;
   }
 
+  // 限流调用点在首次执行时注册，生命周期为静态。
+  void register_site(log_site_limiter* site) {
+    std::unique_lock<std::mutex> lock(sites_mutex_);
+    sites_.push_back(site);
+  }
+
+  // 输出所有调用点被抑制条数的汇总。
+  // 调用点自身放行时会附带汇总；之后再也没有放行的调用点，在第一次抑制的窗口到期后，
+  // 由任意一次日志输出自动触发这里的汇总，也可以由定时任务主动调用。
+  void report_suppressed();
+
+  void schedule_report() {
+    std::uint64_t expected = 0;
+    report_at_.compare_exchange_strong(
+        expected, time::cached_now() + suppressed_window_ns, std::memory_order_relaxed);
+  }
+
+  // 每条日志输出后调用，没有待汇总的窗口时只有一次原子读。
+  void poll_report() {
+    std::uint64_t report_at = report_at_.load(std::memory_order_relaxed);
+    if (report_at == 0 || time::cached_now() < report_at) {
+      return;
+    }
+    // 先清零再汇总，汇总输出的日志不会再次触发。
+    if (report_at_.compare_exchange_strong(report_at, 0, std::memory_order_relaxed)) {
+      report_suppressed();
+    }
+  }
+
 private:
   std::map<std::string, std::unique_ptr<log_target>> targets_;
   std::mutex mutex_;
   std::string default_target_;
+  std::vector<log_site_limiter*> sites_;
+  std::mutex sites_mutex_;
+  // 下次汇总的时间，0 表示没有被抑制的日志。
+  std::atomic<std::uint64_t> report_at_;
 };
 
+inline void schedule_suppressed_report() {
+  log_manager::instance()->schedule_report();
+}
+
 class logger {
 public:
-  logger(const char* target_name, log_level level, const wchar_t* file, int line)
+  logger(const char* target_name, log_level level, const log_char* file, int line)
     : target_(nullptr) {
     target_ = log_manager::instance()->get_target(target_name);
-    stream_ << L"[CALF ";
-    if (target_name != nullptr) {
-      std::string name(target_name);
-      std::transform(name.begin(), name.end(), name.begin(), [](char in) -> char {
-        return static_cast<char>(::toupper(static_cast<int>(in)));
-      });
-      *this << name.c_str() << L" ";
-    }
-    stream_ << get_level_string(level) << "][" << file << L"(" << line << L")] ";
+    record_.timestamp = time::cached_realtime();
+    record_.level = level;
+    record_.target_name = target_name;
+    record_.file = file;
+    record_.line = line;
   }
 
   ~logger() {
-    stream_ << std::endl;
     if (target_ != nullptr) {
-      target_->output(stream_.str());
+      record_.message = stream_.str();
+      target_->write(std::move(record_));
     }
+    log_manager::instance()->poll_report();
   }
 
   template<typename T>
@@ -125,34 +641,131 @@ public:
     return *this;
   }
 
-private:
-  static const wchar_t* get_level_string(log_level level) {
-    switch (level)
-    {
-    case log_level::verbose:
-      return L"VERBOSE";
-    case log_level::info:
-      return L"INFO";
-    case log_level::warn:
-      return L"WARN";
-    case log_level::error:
-      return L"ERROR";
-    case log_level::fatal:
-      return L"FATAL";
-    default:
-      return L"UNKNOWN";
+  // 字符串按日志字符类型输出，类型不同时才转换。
+  logger& operator<< (const char* str) {
+    if (str != nullptr) {
+      put(str, std::char_traits<char>::length(str));
     }
+    return *this;
+  }
+
+  logger& operator<< (const wchar_t* str) {
+    if (str != nullptr) {
+      put(str, std::char_traits<wchar_t>::length(str));
+    }
+    return *this;
+  }
+
+  logger& operator<< (const std::string& str) {
+    put(str.data(), str.size());
+    return *this;
+  }
+
+  logger& operator<< (const std::wstring& str) {
+    put(str.data(), str.size());
+    return *this;
+  }
+
+  logger& operator<< (char c) {
+    put(&c, 1);
+    return *this;
+  }
+
+  logger& operator<< (wchar_t c) {
+    put(&c, 1);
+    return *this;
+  }
+
+  // 结构化字段，用法：CALF_LOG(info).kv("conn", id).kv("bytes", n) << "message";
+  template<typename T>
+  logger& kv(const char* key, T&& value) {
+    record_.fields.emplace_back(key, std::forward<T>(value));
+    return *this;
+  }
+
+  // 附带该调用点被抑制的条数。
+  logger& suppressed(std::uint64_t count) {
+    if (count > 0) {
+      kv("suppressed", count);
+    }
+    return *this;
+  }
+
+protected:
+  void put(const log_char* str, std::size_t length) {
+    stream_.write(str, static_cast<std::streamsize>(length));
+  }
+
+  template<typename CharT>
+  void put(const CharT* str, std::size_t length) {
+    log_string text;
+    append_log_string(text, str, length);
+    stream_.write(text.data(), static_cast<std::streamsize>(text.size()));
   }
 
 protected:
   log_target* target_;
-  std::wstringstream stream_;
+  log_record record_;
+  log_stream stream_;
 };
 
+inline void log_manager::report_suppressed() {
+  std::unique_lock<std::mutex> lock(sites_mutex_);
+  std::vector<log_site_limiter*> sites(sites_);
+  lock.unlock();
+
+  for (auto site : sites) {
+    std::uint64_t count = site->take_suppressed();
+    if (count > 0) {
+      logger(site->target_name(), site->level(), site->file(), site->line())
+          << "suppressed " << count << " messages";
+    }
+  }
+}
+
+template<typename Limiter, typename ...Args>
+Limiter* make_log_site(Args&&... args) {
+  Limiter* site = new Limiter(std::forward<Args>(args)...);
+  log_manager::instance()->register_site(site);
+  return site;
+}
+
 } // namespace logging
 } // namespace calf
 
-#define CALF_LOG(level) calf::logging::logger(nullptr, calf::logging::log_level::level, __FILEW__, __LINE__)
-#define CALF_LOG_TARGET(target, level) calf::logging::logger(#target, calf::logging::log_level::level, __FILEW__, __LINE__)
+// 源文件名，与日志字符类型一致。
+#ifdef CALF_LOG_WIDE_CHAR
+#define CALF_LOG_WIDEN_(str) L##str
+#define CALF_LOG_WIDEN(str) CALF_LOG_WIDEN_(str)
+#define CALF_LOG_FILE CALF_LOG_WIDEN(__FILE__)
+#else
+#define CALF_LOG_FILE __FILE__
+#endif
+
+#define CALF_LOG(level) calf::logging::logger(nullptr, calf::logging::log_level::level, CALF_LOG_FILE, __LINE__)
+#define CALF_LOG_TARGET(target, level) calf::logging::logger(#target, calf::logging::log_level::level, CALF_LOG_FILE, __LINE__)
+
+// 调用点限流，检查在格式化之前完成，被拒绝时不会构造 logger。
+// 用法：CALF_LOG_RATE(error, 10) << "...";  每秒最多 10 条
+//       CALF_LOG_SAMPLE(error, 100) << "..."; 每 100 条输出 1 条
+#define CALF_LOG_SITE_(limiter_type, target_name, level, ...) \
+  for (auto* calf_log_site_ = [&]() { \
+          static auto* site = calf::logging::make_log_site<calf::logging::limiter_type>( \
+              __VA_ARGS__, target_name, calf::logging::log_level::level, CALF_LOG_FILE, __LINE__); \
+          return site; \
+        }(); \
+      calf_log_site_ != nullptr && calf_log_site_->allow(); \
+      calf_log_site_ = nullptr) \
+    calf::logging::logger(target_name, calf::logging::log_level::level, CALF_LOG_FILE, __LINE__) \
+        .suppressed(calf_log_site_->take_suppressed())
+
+#define CALF_LOG_RATE(level, per_second) \
+  CALF_LOG_SITE_(log_rate_limiter, nullptr, level, (per_second), (per_second))
+#define CALF_LOG_TARGET_RATE(target, level, per_second) \
+  CALF_LOG_SITE_(log_rate_limiter, #target, level, (per_second), (per_second))
+#define CALF_LOG_SAMPLE(level, k) \
+  CALF_LOG_SITE_(log_sampler, nullptr, level, (k))
+#define CALF_LOG_TARGET_SAMPLE(target, level, k) \
+  CALF_LOG_SITE_(log_sampler, #target, level, (k))
 
 #endif // CALF_LOGGING_HPP_
\ No newline at end of file
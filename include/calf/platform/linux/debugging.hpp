@@ -3,10 +3,158 @@
 
 #include "posix.hpp"
 
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <cxxabi.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+
 namespace calf {
 namespace platform {
 namespace linux {
 
+// 抓取其它线程的调用栈。
+// 向目标线程发送 capture_signal，在信号处理函数中调用 backtrace 写入静态缓存区，调用方等待写完后符号化。
+// 同一时刻只进行一次抓取。符号名需要以 -rdynamic 链接，否则只有地址。
+class thread_stack {
+public:
+  static const int max_frames = 64;
+
+  // glibc 保留了前几个实时信号，这里使用 SIGRTMIN + 4。
+  static int capture_signal() {
+    return SIGRTMIN + 4;
+  }
+
+  // 返回符号化后的调用栈，每帧一行，超时或失败时返回空字符串。
+  static std::string capture(pthread_t thread, std::chrono::milliseconds timeout = std::chrono::milliseconds(100)) {
+    std::lock_guard<std::mutex> lock(capture_mutex());
+    if (!install()) {
+      return std::string();
+    }
+
+    state& s = get_state();
+    s.ready.store(false, std::memory_order_relaxed);
+    s.count = 0;
+    s.target.store(true, std::memory_order_release);
+    if (::pthread_kill(thread, capture_signal()) != 0) {
+      s.target.store(false, std::memory_order_relaxed);
+      return std::string();
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!s.ready.load(std::memory_order_acquire)) {
+      if (std::chrono::steady_clock::now() >= deadline) {
+        // 超时后信号处理函数即使稍后执行也不会再写缓存区。
+        if (s.target.exchange(false, std::memory_order_acq_rel)) {
+          return std::string();
+        }
+        while (!s.ready.load(std::memory_order_acquire)) {
+          std::this_thread::yield();
+        }
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    return format(s.frames, s.count);
+  }
+
+  // 符号化并去掉 C++ 名字修饰，跳过信号处理函数自身的两帧。
+  static std::string format(void* const* frames, int count) {
+    std::ostringstream stream;
+    char** symbols = ::backtrace_symbols(frames, count);
+    for (int i = 2; i < count; ++i) {
+      stream << "  #" << (i - 2) << ' ';
+      if (symbols != nullptr) {
+        stream << demangle_symbol(symbols[i]);
+      } else {
+        stream << frames[i];
+      }
+      stream << '\n';
+    }
+    std::free(symbols);
+    return stream.str();
+  }
+
+  static std::string demangle(const char* name) {
+    int status = 0;
+    char* result = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (result == nullptr || status != 0) {
+      std::free(result);
+      return name;
+    }
+    std::string value(result);
+    std::free(result);
+    return value;
+  }
+
+private:
+  struct state {
+    std::atomic_bool target;
+    std::atomic_bool ready;
+    void* frames[max_frames];
+    int count;
+  };
+
+  static state& get_state() {
+    static state s;
+    return s;
+  }
+
+  static std::mutex& capture_mutex() {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  static bool install() {
+    static bool installed = false;
+    if (installed) {
+      return true;
+    }
+    // backtrace 第一次调用时会加载 libgcc，先在普通上下文中调用一次，避免在信号处理函数中分配内存。
+    void* frames[2];
+    ::backtrace(frames, 2);
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = &signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    installed = ::sigaction(capture_signal(), &action, nullptr) == 0;
+    return installed;
+  }
+
+  static void signal_handler(int) {
+    int saved_errno = errno;
+    state& s = get_state();
+    if (s.target.exchange(false, std::memory_order_acq_rel)) {
+      s.count = ::backtrace(s.frames, max_frames);
+      s.ready.store(true, std::memory_order_release);
+    }
+    errno = saved_errno;
+  }
+
+  // backtrace_symbols 的格式为 "module(symbol+offset) [address]"。
+  static std::string demangle_symbol(const char* text) {
+    std::string line(text);
+    std::size_t begin = line.find('(');
+    std::size_t end = line.find('+', begin);
+    if (begin == std::string::npos || end == std::string::npos || end == begin + 1) {
+      return line;
+    }
+    std::string name = line.substr(begin + 1, end - begin - 1);
+    return line.substr(0, begin + 1) + demangle(name.c_str()) + line.substr(end);
+  }
+};
+
 } // namespace linux
 } // namespace platform
 } // namespace calf
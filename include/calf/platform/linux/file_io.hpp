@@ -2,14 +2,52 @@
 #define CALF_PLATFORM_LINUX_FILE_IO_HPP
 
 #include "posix.hpp"
+#include "../../logging.hpp"
+#include "../../log_encoding.hpp"
+#include "../../time.hpp"
+#include "../../timer_wheel.hpp"
+#include "../../io_buffer.hpp"
+#include "../../watchdog.hpp"
 
 #include <vector>
+#include <algorithm>
 #include <atomic>
 #include <map>
+#include <memory>
 #include <functional>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <typeinfo>
+#include <cstdint>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
 
+#include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+#ifndef SO_BUSY_POLL_BUDGET
+#define SO_BUSY_POLL_BUDGET 70
+#endif
 
 namespace calf {
 namespace platform {
@@ -17,49 +55,108 @@ namespace linux {
 
 enum struct io_type {
   unknown,
-  read, 
-  write
+  create,
+  open,
+  write, 
+  read,
+  close,
+  broken
 };
 
-using io_buffer = std::vector<uint8_t>;
+// 池化缓存区，扩大时不清零。
+using io_buffer = calf::pooled_buffer;
 
 // 文件描述符
 class file_descriptor {
 public:
   file_descriptor() : fd_(-1) {}
-  ~file_descriptor() {
+  file_descriptor(int fd) : fd_(fd) {}
+  ~file_descriptor() { close(); }
+
+  int get_fd() { return fd_; }
+  bool is_invalid() { return fd_ < 0; }
+  bool is_valid() { return !is_invalid(); }
+
+  void reset(int fd) {
+    close();
+    fd_ = fd;
+  }
+
+  void close() {
     if (fd_ >= 0) {
       ::close(fd_);
       fd_ = -1;
     }
   }
 
-  int get_fd() { return fd_; }
-  bool is_invalid() { return fd_ < 0; }
-  bool is_valid() { return !is_invalid(); }
+  // 放弃所有权，返回原描述符。
+  int release_fd() {
+    int fd = fd_;
+    fd_ = -1;
+    return fd;
+  }
 
 protected:
   int fd_;
 };
 
-struct io_event_context;
+template<typename Handler>
+struct basic_io_event_context;
+class io_event_handler;
+// 默认的描述符上下文，通过虚函数分发给 io_event_handler。
+using io_event_context = basic_io_event_context<io_event_handler>;
 struct io_context;
 
 using io_handler = std::function<void(io_context& context)>;
 
+// 关注的事件，可以按位组合。
+struct io_event {
+  static const std::uint32_t read = EPOLLIN | EPOLLRDHUP;
+  static const std::uint32_t write = EPOLLOUT;
+  // 边沿触发，处理者必须读写到 EAGAIN 为止。默认为水平触发。
+  static const std::uint32_t edge_triggered = EPOLLET;
+  // 触发一次后自动停止关注，需要调用 rearm_fd 重新开启。
+  static const std::uint32_t oneshot = EPOLLONESHOT;
+};
+
 class io_event_handler {
 public:
   virtual void io_event_arrived(io_event_context* context) = 0;
-  virtual void io_broken() {}
+  // 出错或对端挂断且没有可读数据时调用，err 为套接字错误码，挂断时为 0。
+  virtual void io_broken(io_event_context* /*context*/, int /*err*/) {}
 };
 
-struct io_event_context {
-  io_event_context() 
+// 注册到反应器的描述符上下文，Handler 为处理者类型。
+template<typename Handler>
+struct basic_io_event_context {
+  basic_io_event_context()
     : event_handler(nullptr), 
-      type(io_type::unknown) {}
+      type(io_type::unknown),
+      fd(-1),
+      interest(0),
+      events(0),
+      deferred(false),
+      dispatch_count(0),
+      busy_ns(0),
+      max_busy_ns(0) {}
 
-  io_event_handler* event_handler;
+  bool is_readable() const { return (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) != 0; }
+  bool is_writable() const { return (events & EPOLLOUT) != 0; }
+  bool is_hangup() const { return (events & (EPOLLRDHUP | EPOLLHUP)) != 0; }
+
+  Handler* event_handler;
   io_type type;
+  int fd;
+  // 注册时关注的事件。
+  std::uint32_t interest;
+  // 本次触发的事件，可读和可写同时触发时 type 为 read，处理者应检查 is_writable。
+  std::uint32_t events;
+  // 已经放入就绪列表，等待下一轮继续处理。
+  bool deferred;
+  // 开启统计后累计的分发次数、处理耗时和单次最长耗时，单位纳秒。
+  std::uint64_t dispatch_count;
+  std::uint64_t busy_ns;
+  std::uint64_t max_busy_ns;
 };
 
 struct io_context 
@@ -76,64 +173,2042 @@ public:
   }
 
   void create() {
-    fd_ = ::epoll_create(1000); // 最大轮询 fd 数量
+    reset(::epoll_create1(EPOLL_CLOEXEC));
+  }
+
+  bool add(int fd, std::uint32_t events, void* data) {
+    return control(EPOLL_CTL_ADD, fd, events, data);
+  }
+
+  bool modify(int fd, std::uint32_t events, void* data) {
+    return control(EPOLL_CTL_MOD, fd, events, data);
+  }
+
+  bool remove(int fd) {
+    return control(EPOLL_CTL_DEL, fd, 0, nullptr);
   }
 
   void associate(int fd, io_event_context* context) {
-    epoll_event ev;
-    ev.events = EPOLLIN;
-    ev.data.ptr = context;
-    ::epoll_ctl(fd_, EPOLL_CTL_ADD, fd, &ev);
+    add(fd, EPOLLIN, context);
   }
 
-  int wait(epoll_event* events, int events_count) {
-    int ret = ::epoll_wait(fd_, events, events_count, -1);
+  // 返回就绪事件数，被信号中断时返回 0，出错返回 -1。
+  int wait(epoll_event* events, int events_count, int timeout = -1) {
+    int ret = ::epoll_wait(fd_, events, events_count, timeout);
+    if (ret < 0 && errno == EINTR) {
+      return 0;
+    }
     return ret;
   }
+
+private:
+  bool control(int op, int fd, std::uint32_t events, void* data) {
+    epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = data;
+    return ::epoll_ctl(fd_, op, fd, &ev) == 0;
+  }
+};
+
+// eventfd 通知对象，多次通知在被消费前合并为一次。
+class event_notifier
+  : public file_descriptor {
+public:
+  event_notifier() {
+    reset(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  }
+
+  void notify() {
+    std::uint64_t value = 1;
+    ssize_t ret = 0;
+    do {
+      ret = ::write(fd_, &value, sizeof(value));
+    } while (ret < 0 && errno == EINTR);
+  }
+
+  // 清除通知，返回累计的通知次数。
+  std::uint64_t consume() {
+    std::uint64_t value = 0;
+    ssize_t ret = 0;
+    do {
+      ret = ::read(fd_, &value, sizeof(value));
+    } while (ret < 0 && errno == EINTR);
+    return ret == sizeof(value) ? value : 0;
+  }
+};
+
+// 忙轮询参数，默认关闭。
+// 开启后反应器在阻塞之前以零超时反复调用 epoll_wait，用一个独占的 CPU 核换取更低的唤醒延迟。
+struct busy_poll_options {
+  // 没有事件时继续空转的时长，单位纳秒，超过后退回阻塞等待，0 表示不空转。
+  std::uint64_t spin_ns = 0;
+  // 注册的套接字设置 SO_BUSY_POLL，单位微秒，0 表示不设置。
+  // 超过 net.core.busy_read 的值需要 CAP_NET_ADMIN 权限，设置失败时忽略。
+  int socket_poll_us = 0;
+  // SO_BUSY_POLL_BUDGET，每次忙轮询处理的最大包数，0 表示使用内核默认值。
+  int socket_poll_budget = 0;
+  // SO_PREFER_BUSY_POLL，忙轮询期间推迟软中断处理。
+  bool prefer_busy_poll = false;
+  // run_loop 所在线程绑定的 CPU，-1 表示不绑定。
+  int cpu = -1;
+};
+
+// 事件分发统计，开启 set_instrumentation 后累计。
+struct dispatch_stats {
+  std::uint64_t events = 0;
+  // 超出预算后放入就绪列表再次分发的次数。
+  std::uint64_t deferred = 0;
+  std::uint64_t busy_ns = 0;
+  std::uint64_t max_busy_ns = 0;
 };
 
-class io_multiplexing_service {
+// 基于 epoll 的反应器。
+// 每个文件描述符对应一个 io_event_context，注册时可以选择水平或边沿触发、是否单次触发。
+// 其它线程通过 dispatch 把任务交给反应器线程执行，任务队列由 eventfd 唤醒，
+// 反应器取走任务前的多次投递只写一次 eventfd。
+// 定时器由分层时间轮管理，epoll_wait 的超时取到下一个定时器到期，不需要额外的 timerfd。
+//
+// Handler 为处理者类型，事件分发直接调用 Handler 的 io_event_arrived / io_broken。
+// 默认的 io_multiplexing_service 以 io_event_handler 实例化，经虚函数分发，不同类型的处理者可以注册到同一个反应器；
+// 所有描述符都由同一种处理者处理时，以该类型实例化，回调静态分发并可以内联，处理者不需要继承 io_event_handler。
+template<typename Handler>
+class basic_io_multiplexing_service {
 public:
-  io_multiplexing_service()
-    : quit_flag_(ATOMIC_VAR_INIT(false)) {
-    events_.resize(100); // 最大返回事件数
+  using task_t = std::function<void(void)>;
+  using timer_id = timer_wheel::timer_id;
+  using handler_type = Handler;
+  using context_type = basic_io_event_context<Handler>;
+
+  // 就绪事件数组的初始和最大长度，一轮返回的事件填满数组时长度加倍。
+  static const std::size_t default_events_count = 128;
+  static const std::size_t max_events_count = 64 * 1024;
+  // 定时器精度，与 epoll_wait 的超时精度一致。
+  static const std::uint64_t timer_tick_ns = 1000000;
+  // 每个处理者每次唤醒默认最多读取的字节数。
+  static const std::size_t default_read_budget = 256 * 1024;
+
+public:
+  basic_io_multiplexing_service()
+    : quit_flag_(ATOMIC_VAR_INIT(false)),
+      wait_timeout_(-1),
+      ready_count_(0),
+      dispatch_index_(0),
+      deferred_index_(0),
+      read_budget_(default_read_budget),
+      instrumented_(false),
+      current_(nullptr),
+      notified_(ATOMIC_VAR_INIT(false)),
+      timers_(timer_tick_ns, time::now()) {
+    events_.resize(default_events_count);
+    register_fd(notifier_, &notifier_context_, io_event::read);
   }
 
   void run_loop() {
+    loop_thread_ = std::this_thread::get_id();
+    heartbeat_.attach();
+    if (busy_poll_.cpu >= 0) {
+      set_thread_affinity(::pthread_self(), static_cast<std::size_t>(busy_poll_.cpu));
+    }
     while(!quit_flag_.load(std::memory_order_relaxed)) {
-      int ret = epoll_.wait(events_.data(), events_.size());
-      for (auto& ev : events_) {
-        io_event_context* context = reinterpret_cast<io_event_context*>(ev.data.ptr);
-        if (context != nullptr) {
-          if (ev.events & EPOLLIN) {
-            context->type = io_type::read;
-          } else if (ev.events & EPOLLOUT) {
-            context->type = io_type::write;
-          }
-
-          io_event_handler* handler = context->event_handler;
-          if (handler != nullptr) {
-            handler->io_event_arrived(context);
-          }
-        }
+      int ret = wait_events();
+      time::loop_clock::update();
+      if (ret < 0) {
+        CALF_LOG(error) << "epoll_wait failed with error " << errno;
+        break;
       }
+      // 先处理上一轮用完预算的描述符，本轮事件中再次用完预算的留到下一轮，每次唤醒最多一份预算。
+      dispatch_deferred();
+      dispatch_events(ret);
+      advance_timers();
     }
+    heartbeat_.detach();
+    loop_thread_ = std::thread::id();
+    time::loop_clock::reset();
+  }
+
+  bool is_in_loop_thread() const {
+    return loop_thread_ == std::this_thread::get_id();
   }
 
+  // 可以在任意线程调用，会唤醒阻塞中的 run_loop。
   void quit() {
     quit_flag_.store(true, std::memory_order_relaxed);
+    notifier_.notify();
+  }
+
+  // 投递任务到反应器线程执行。
+  void post(task_t task) {
+    std::unique_lock<std::mutex> lock(tasks_mutex_);
+    tasks_.emplace_back(std::move(task));
+    lock.unlock();
+    if (!notified_.exchange(true, std::memory_order_acq_rel)) {
+      notifier_.notify();
+    }
+  }
+
+  template<typename Fn, typename ...Args>
+  void dispatch(Fn&& fn, Args&&... args) {
+    post(std::bind(std::forward<Fn>(fn), std::forward<Args>(args)...));
+  }
+
+  template<typename Fn, typename ...Args>
+  auto packaged_dispatch(Fn&& fn, Args&&... args)
+      -> std::future<decltype(std::bind(std::forward<Fn>(fn), std::forward<Args>(args)...)())> {
+    using result_t = decltype(std::bind(std::forward<Fn>(fn), std::forward<Args>(args)...)());
+    auto pkg_task = std::make_shared<std::packaged_task<result_t(void)>>(
+        std::bind(std::forward<Fn>(fn), std::forward<Args>(args)...));
+    auto task_future = pkg_task->get_future();
+    post([pkg_task]() {
+      (*pkg_task)();
+    });
+    return task_future;
+  }
+
+  // 定时器只能在反应器线程中设置和取消，其它线程通过 dispatch 转交。
+  // 时间以 calf::time::now() 为准，单位纳秒，精度为 timer_tick_ns，不会早于指定时间触发。
+  timer_id schedule_at(std::uint64_t time_ns, task_t task) {
+    return timers_.schedule(time_ns, 0, std::move(task));
+  }
+
+  template<typename Rep, typename Period>
+  timer_id schedule_after(std::chrono::duration<Rep, Period> delay, task_t task) {
+    return timers_.schedule(time::loop_clock::now() + to_ns(delay), 0, std::move(task));
+  }
+
+  // 周期定时器，在回调中取消自己是安全的。
+  template<typename Rep, typename Period>
+  timer_id schedule_every(std::chrono::duration<Rep, Period> interval, task_t task) {
+    std::uint64_t interval_ns = to_ns(interval);
+    return timers_.schedule(time::loop_clock::now() + interval_ns, interval_ns, std::move(task));
+  }
+
+  // 返回定时器是否仍在等待，已经触发或取消过的定时器返回 false。
+  bool cancel_timer(const timer_id& id) {
+    return timers_.cancel(id);
+  }
+
+  std::size_t get_timer_count() const {
+    return timers_.size();
+  }
+
+  // epoll_wait 最长等待时间，单位毫秒，-1 表示一直等待。
+  void set_wait_timeout(int timeout) {
+    wait_timeout_ = timeout;
+  }
+
+  // 每个处理者每次唤醒最多读取的字节数，0 表示读到 EAGAIN 为止。
+  // 边沿触发的处理者用完预算后调用 defer，剩余数据在下一轮处理，一个高速连接不会饿死同一反应器上的其它连接。
+  void set_read_budget(std::size_t bytes) {
+    read_budget_ = bytes;
+  }
+
+  std::size_t get_read_budget() const {
+    return read_budget_;
+  }
+
+  // 放入就绪列表，下一轮在处理新的 epoll 事件之前再次以可读事件调用处理者。
+  // 就绪列表不为空时 epoll_wait 不阻塞。只能在反应器线程中调用。
+  void defer(context_type* context) {
+    if (!context->deferred) {
+      context->deferred = true;
+      deferred_.push_back(context);
+    }
+  }
+
+  // 开启后统计每次分发的耗时，累计到描述符上下文和 dispatch_stats。
+  void set_instrumentation(bool enable) {
+    instrumented_ = enable;
+  }
+
+  // 在反应器线程中调用，其它线程通过 packaged_dispatch 获取。
+  const dispatch_stats& get_dispatch_stats() const {
+    return stats_;
+  }
+
+  // 交给 calf::watchdog 监视，处理者、投递的任务和定时器执行过久时报告。
+  loop_heartbeat& get_heartbeat() {
+    return heartbeat_;
+  }
+
+  // 在 run_loop 之前设置，套接字选项只作用于之后注册的描述符。
+  void set_busy_poll(const busy_poll_options& options) {
+    busy_poll_ = options;
+  }
+
+  const busy_poll_options& get_busy_poll() const {
+    return busy_poll_;
+  }
+
+  // 把线程绑定到一个 CPU 上，cpu 超过核数时取模。
+  static bool set_thread_affinity(pthread_t thread, std::size_t cpu) {
+    long cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus <= 0) {
+      return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % static_cast<std::size_t>(cpus), &set);
+    int ret = ::pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (ret != 0) {
+      CALF_LOG(warn) << "pin reactor thread to cpu " << cpu << " failed with error " << ret;
+      return false;
+    }
+    return true;
+  }
+
+  bool register_fd(
+      file_descriptor& fd,
+      context_type* context,
+      std::uint32_t events = io_event::read) {
+    return register_fd(fd.get_fd(), context, events);
+  }
+
+  bool register_fd(int fd, context_type* context, std::uint32_t events = io_event::read) {
+    context->fd = fd;
+    context->interest = events;
+    if (busy_poll_.socket_poll_us > 0) {
+      set_socket_busy_poll(fd);
+    }
+    return epoll_.add(fd, events, context);
+  }
+
+  // 修改关注的事件。
+  bool modify_fd(context_type* context, std::uint32_t events) {
+    context->interest = events;
+    return epoll_.modify(context->fd, events, context);
+  }
+
+  // 单次触发的描述符处理完后重新开启。
+  bool rearm_fd(context_type* context) {
+    return epoll_.modify(context->fd, context->interest, context);
+  }
+
+  // 开启或关闭可写通知，关注的事件没有变化时不产生系统调用。
+  bool watch_write(context_type* context, bool enable) {
+    std::uint32_t events = enable
+        ? (context->interest | io_event::write)
+        : (context->interest & ~io_event::write);
+    if (events == context->interest) {
+      return true;
+    }
+    return modify_fd(context, events);
+  }
+
+  // 注销后本轮尚未分发的事件也会丢弃，处理者可以在回调中注销并释放其它描述符。
+  bool deregister_fd(context_type* context) {
+    for (std::size_t i = dispatch_index_; i < ready_count_; ++i) {
+      if (events_[i].data.ptr == context) {
+        events_[i].data.ptr = nullptr;
+      }
+    }
+    if (current_ == context) {
+      current_ = nullptr;
+    }
+    if (context->deferred) {
+      context->deferred = false;
+      std::replace(deferred_.begin(), deferred_.end(), context, static_cast<context_type*>(nullptr));
+    }
+    for (std::size_t i = deferred_index_; i < running_deferred_.size(); ++i) {
+      if (running_deferred_[i] == context) {
+        running_deferred_[i] = nullptr;
+      }
+    }
+    bool ret = epoll_.remove(context->fd);
+    context->fd = -1;
+    context->interest = 0;
+    return ret;
+  }
+
+private:
+  // 通知到达，先清除标志再取任务，之后的投递会重新写 eventfd。
+  // 取出的一批任务全部执行完再检查退出，与 file_io_service 一致，已经取出的任务不会被丢弃，
+  // 例如 packaged_dispatch 的 future 一定能拿到结果。quit 之后才投递的任务留在队列中，随反应器析构。
+  void run_tasks() {
+    notifier_.consume();
+    notified_.store(false, std::memory_order_release);
+
+    std::unique_lock<std::mutex> lock(tasks_mutex_);
+    running_tasks_.swap(tasks_);
+    lock.unlock();
+
+    bool watched = heartbeat_.is_watched();
+    for (auto& task : running_tasks_) {
+      if (watched) {
+        heartbeat_.begin(task.target_type().name());
+      }
+      task();
+    }
+    if (watched) {
+      heartbeat_.end();
+    }
+    running_tasks_.clear();
+  }
+
+  template<typename Rep, typename Period>
+  static std::uint64_t to_ns(std::chrono::duration<Rep, Period> duration) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+    return ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+  }
+
+  // 忙轮询时先以零超时空转，期间有事件、定时器到期或要求退出时立即返回，空转超过 spin_ns 后阻塞等待。
+  int wait_events() {
+    int count = static_cast<int>(events_.size());
+    if (!deferred_.empty()) {
+      return epoll_.wait(events_.data(), count, 0);
+    }
+    if (busy_poll_.spin_ns != 0) {
+      std::uint64_t deadline = time::now() + busy_poll_.spin_ns;
+      for (;;) {
+        int ret = epoll_.wait(events_.data(), count, 0);
+        if (ret != 0 || quit_flag_.load(std::memory_order_relaxed)) {
+          return ret;
+        }
+        std::uint64_t now = time::now();
+        if (timers_.next_timeout(now) == 0 || now >= deadline) {
+          break;
+        }
+      }
+    }
+    return epoll_.wait(events_.data(), count, get_timeout());
+  }
+
+  // 非套接字描述符设置失败，直接忽略。
+  void set_socket_busy_poll(int fd) {
+    int value = busy_poll_.socket_poll_us;
+    ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value));
+    if (busy_poll_.prefer_busy_poll) {
+      value = 1;
+      ::setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &value, sizeof(value));
+    }
+    if (busy_poll_.socket_poll_budget > 0) {
+      value = busy_poll_.socket_poll_budget;
+      ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET, &value, sizeof(value));
+    }
+  }
+
+  // 取 wait_timeout_ 与下一个定时器到期时间中较小的一个，定时器超时向上取整到毫秒。
+  int get_timeout() const {
+    std::int64_t timer_ns = timers_.next_timeout(time::now());
+    if (timer_ns < 0) {
+      return wait_timeout_;
+    }
+    std::int64_t timer_ms = (timer_ns + 999999) / 1000000;
+    if (timer_ms > INT_MAX) {
+      timer_ms = INT_MAX;
+    }
+    if (wait_timeout_ >= 0 && wait_timeout_ < timer_ms) {
+      return wait_timeout_;
+    }
+    return static_cast<int>(timer_ms);
+  }
+
+  void dispatch_events(int count) {
+    ready_count_ = static_cast<std::size_t>(count);
+    for (dispatch_index_ = 0; dispatch_index_ < ready_count_; ) {
+      epoll_event& ev = events_[dispatch_index_++];
+      context_type* context = reinterpret_cast<context_type*>(ev.data.ptr);
+      if (context == nullptr) {
+        continue;
+      }
+      if (context == &notifier_context_) {
+        run_tasks();
+        continue;
+      }
+
+      context->events = ev.events;
+      Handler* handler = context->event_handler;
+      if (handler == nullptr) {
+        continue;
+      }
+
+      if ((ev.events & EPOLLERR) ||
+          ((ev.events & EPOLLHUP) && !(ev.events & EPOLLIN))) {
+        handler->io_broken(context, (ev.events & EPOLLERR) ? get_error(context->fd) : 0);
+        continue;
+      }
+
+      if (context->is_readable()) {
+        context->type = io_type::read;
+      } else if (context->is_writable()) {
+        context->type = io_type::write;
+      }
+      invoke(handler, context);
+    }
+    ready_count_ = 0;
+    dispatch_index_ = 0;
+
+    if (static_cast<std::size_t>(count) == events_.size() &&
+        events_.size() < max_events_count) {
+      events_.resize(events_.size() * 2);
+    }
+  }
+
+  // 上一轮用完预算的处理者按入队顺序再处理一次，本轮再次 defer 的留到下一轮。
+  void dispatch_deferred() {
+    if (deferred_.empty()) {
+      return;
+    }
+    running_deferred_.swap(deferred_);
+    for (deferred_index_ = 0; deferred_index_ < running_deferred_.size(); ) {
+      context_type* context = running_deferred_[deferred_index_++];
+      if (context == nullptr || context->event_handler == nullptr) {
+        continue;
+      }
+      context->deferred = false;
+      context->events = EPOLLIN;
+      context->type = io_type::read;
+      if (instrumented_) {
+        ++stats_.deferred;
+      }
+      invoke(context->event_handler, context);
+    }
+    running_deferred_.clear();
+    deferred_index_ = 0;
+  }
+
+  void invoke(Handler* handler, context_type* context) {
+    bool watched = heartbeat_.is_watched();
+    if (!instrumented_ && !watched) {
+      handler->io_event_arrived(context);
+      return;
+    }
+    if (watched) {
+      heartbeat_.begin(typeid(*handler).name());
+    }
+    std::uint64_t start = time::now();
+    current_ = context;
+    handler->io_event_arrived(context);
+    if (instrumented_) {
+      record(start);
+    }
+    current_ = nullptr;
+    heartbeat_.end();
+  }
+
+  void advance_timers() {
+    if (!heartbeat_.is_watched()) {
+      timers_.advance(time::loop_clock::now());
+      return;
+    }
+    heartbeat_.begin(typeid(timer_wheel).name());
+    timers_.advance(time::loop_clock::now());
+    heartbeat_.end();
+  }
+
+  // 处理者可能在回调中注销并释放自己，注销时清空 current_，之后不再访问它的 context。
+  void record(std::uint64_t start) {
+    std::uint64_t elapsed = time::now() - start;
+    ++stats_.events;
+    stats_.busy_ns += elapsed;
+    if (elapsed > stats_.max_busy_ns) {
+      stats_.max_busy_ns = elapsed;
+    }
+    if (current_ != nullptr) {
+      ++current_->dispatch_count;
+      current_->busy_ns += elapsed;
+      if (elapsed > current_->max_busy_ns) {
+        current_->max_busy_ns = elapsed;
+      }
+    }
   }
 
-  void register_fd(file_descriptor& fd, io_event_context* context) {
-    epoll_.associate(fd.get_fd(), context);
+  static int get_error(int fd) {
+    int err = 0;
+    socklen_t length = sizeof(err);
+    if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &length) != 0 || err == 0) {
+      return EIO;
+    }
+    return err;
   }
 
 private:
   io_multiplexing_epoll epoll_;
   std::atomic_bool quit_flag_;
+  std::thread::id loop_thread_;
+  int wait_timeout_;
+  busy_poll_options busy_poll_;
   std::vector<epoll_event> events_;
+  std::size_t ready_count_;
+  std::size_t dispatch_index_;
+  // 用完预算等待继续处理的描述符，running_deferred_ 为本轮正在处理的列表。
+  std::vector<context_type*> deferred_;
+  std::vector<context_type*> running_deferred_;
+  std::size_t deferred_index_;
+  std::size_t read_budget_;
+  bool instrumented_;
+  dispatch_stats stats_;
+  // 开启统计时正在分发的描述符。
+  context_type* current_;
+
+  event_notifier notifier_;
+  context_type notifier_context_;
+  std::atomic_bool notified_;
+  std::vector<task_t> tasks_;
+  std::vector<task_t> running_tasks_;
+  std::mutex tasks_mutex_;
+
+  timer_wheel timers_;
+  loop_heartbeat heartbeat_;
+};
+
+using io_multiplexing_service = basic_io_multiplexing_service<io_event_handler>;
+
+// 在反应器线程中执行任务，与 Windows 版本的 io_completion_worker 接口一致。
+class io_completion_worker {
+public:
+  io_completion_worker(io_multiplexing_service& service)
+    : service_(service) {}
+
+  template<typename ...Args>
+  void dispatch(Args&&... args) {
+    service_.dispatch(std::forward<Args>(args)...);
+  }
+
+  template<typename ...Args>
+  auto packaged_dispatch(Args&&... args)
+      -> decltype(std::declval<io_multiplexing_service&>().packaged_dispatch(std::forward<Args>(args)...)) {
+    return service_.packaged_dispatch(std::forward<Args>(args)...);
+  }
+
+private:
+  io_multiplexing_service& service_;
+};
+
+struct io_multiplexing_pool_options {
+  // 反应器数量，0 表示与 CPU 核数相同。
+  std::size_t threads = 0;
+  // 反应器线程依次绑定到 CPU 上。
+  bool pin_threads = false;
+  // 绑定的起始 CPU 编号。
+  std::size_t first_cpu = 0;
+  // 每个反应器的忙轮询参数，开启空转时反应器线程总是绑定 CPU。
+  busy_poll_options busy_poll;
+};
+
+// 多反应器线程池，每个线程运行一个独立的 io_multiplexing_service。
+// 描述符注册到哪个反应器就一直由哪个线程处理，连接之间不共享锁。
+class io_multiplexing_pool {
+public:
+  io_multiplexing_pool(const io_multiplexing_pool_options& options = io_multiplexing_pool_options())
+    : options_(options),
+      next_(0) {
+    std::size_t count = options_.threads;
+    if (count == 0) {
+      count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      services_.emplace_back(new io_multiplexing_service());
+      services_.back()->set_busy_poll(options_.busy_poll);
+    }
+  }
+
+  ~io_multiplexing_pool() {
+    stop();
+    join();
+  }
+
+  void start() {
+    if (!threads_.empty()) {
+      return;
+    }
+    for (std::size_t i = 0; i < services_.size(); ++i) {
+      threads_.emplace_back(&io_multiplexing_service::run_loop, services_[i].get());
+      if (options_.pin_threads || options_.busy_poll.spin_ns != 0) {
+        io_multiplexing_service::set_thread_affinity(
+            threads_.back().native_handle(), options_.first_cpu + i);
+      }
+    }
+  }
+
+  // 通知所有反应器退出，可以在其它线程中调用。
+  void stop() {
+    for (auto& service : services_) {
+      service->quit();
+    }
+  }
+
+  // 等待所有反应器线程退出。
+  void join() {
+    for (auto& thread : threads_) {
+      if (thread.joinable()) {
+        thread.join();
+      }
+    }
+    threads_.clear();
+  }
+
+  std::size_t size() { return services_.size(); }
+
+  io_multiplexing_service& get_service(std::size_t index) {
+    return *services_[index % services_.size()];
+  }
+
+  // 轮流选择反应器，用于主动发起的连接。
+  io_multiplexing_service& next_service() {
+    return get_service(next_.fetch_add(1, std::memory_order_relaxed));
+  }
+
+private:
+  io_multiplexing_pool_options options_;
+  std::vector<std::unique_ptr<io_multiplexing_service>> services_;
+  std::vector<std::thread> threads_;
+  std::atomic<std::size_t> next_;
+};
+
+class file
+  : public file_descriptor {
+public:
+  static const std::size_t default_buffer_size = 4 * 1024;
+  static const std::size_t max_buffer_size = 128 * 1024 * 1024;
+
+public:
+  file() {}
+
+  file(const std::string& file_path, int flags = O_RDWR | O_CREAT, mode_t mode = 0644) {
+    open(file_path, flags, mode);
+  }
+
+  // 托管了文件描述符生命周期，所以禁止拷贝构造。
+  file(const file& other) = delete;
+
+  // 提供移动语义。
+  file(file&& other) {
+    fd_ = other.fd_;
+    other.fd_ = -1;
+  }
+
+  bool open(const std::string& file_path, int flags = O_RDWR | O_CREAT, mode_t mode = 0644) {
+    reset(::open(file_path.c_str(), flags | O_CLOEXEC, mode));
+    return is_valid();
+  }
+
+  ssize_t read(void* data, std::size_t size) {
+    ssize_t ret = 0;
+    do {
+      ret = ::read(fd_, data, size);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+  }
+
+  ssize_t write(const void* data, std::size_t size) {
+    ssize_t ret = 0;
+    do {
+      ret = ::write(fd_, data, size);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+  }
+
+  // 聚集写，一次系统调用写入多个缓存区，处理了部分写入。
+  // 注意：会修改 iov 数组内容。
+  bool write_all(iovec* iov, int count) {
+    while (count > 0) {
+      int batch = count < IOV_MAX ? count : IOV_MAX;
+      ssize_t ret = ::writev(fd_, iov, batch);
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+
+      std::size_t written = static_cast<std::size_t>(ret);
+      while (count > 0 && written >= iov->iov_len) {
+        written -= iov->iov_len;
+        ++iov;
+        --count;
+      }
+      if (count > 0 && written > 0) {
+        iov->iov_base = static_cast<std::uint8_t*>(iov->iov_base) + written;
+        iov->iov_len -= written;
+      }
+    }
+    return true;
+  }
+
+  bool datasync() {
+    return ::fdatasync(fd_) == 0;
+  }
+
+  off_t size() {
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+      return -1;
+    }
+    return st.st_size;
+  }
 };
 
+// 直接 IO 文件，以 O_DIRECT 打开，读写绕过页缓存，不与页缓存重复占用内存，也没有回写造成的延迟抖动。
+// 内存地址、文件偏移和长度都必须按 get_alignment() 对齐，缓存区可以用 aligned_buffer 分配；
+// read_at / write_at 要求三者都对齐，不满足时返回 -1，errno 为 EINVAL。
+// read_all / write_all 的长度可以不对齐，不足一块的尾部经过一块对齐的中转缓存读写。
+// 文件系统不支持 O_DIRECT 时（例如 tmpfs）退回普通打开，is_direct() 返回 false，对齐要求不变。
+class direct_file
+  : public file {
+public:
+  direct_file()
+    : alignment_(aligned_buffer::default_alignment),
+      direct_(false) {}
+
+  direct_file(const std::string& file_path, int flags = O_RDWR | O_CREAT, mode_t mode = 0644)
+    : direct_file() {
+    open(file_path, flags, mode);
+  }
+
+  direct_file(direct_file&& other) = default;
+
+  bool open(const std::string& file_path, int flags = O_RDWR | O_CREAT, mode_t mode = 0644) {
+    direct_ = true;
+    if (!file::open(file_path, flags | O_DIRECT, mode)) {
+      if (errno != EINVAL) {
+        return false;
+      }
+      direct_ = false;
+      if (!file::open(file_path, flags, mode)) {
+        return false;
+      }
+    }
+
+    // 块设备按逻辑块大小对齐，普通文件按 4KB 对齐，覆盖 512B 和 4KB 扇区。
+    alignment_ = aligned_buffer::default_alignment;
+    struct stat st;
+    int block_size = 0;
+    if (::fstat(fd_, &st) == 0 && S_ISBLK(st.st_mode) &&
+        ::ioctl(fd_, BLKSSZGET, &block_size) == 0 &&
+        static_cast<std::size_t>(block_size) > alignment_) {
+      alignment_ = static_cast<std::size_t>(block_size);
+    }
+    return true;
+  }
+
+  ssize_t read_at(off_t offset, void* data, std::size_t size) {
+    if (!is_aligned(offset, data, size)) {
+      errno = EINVAL;
+      return -1;
+    }
+    ssize_t ret = 0;
+    do {
+      ret = ::pread(fd_, data, size, offset);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+  }
+
+  ssize_t write_at(off_t offset, const void* data, std::size_t size) {
+    if (!is_aligned(offset, data, size)) {
+      errno = EINVAL;
+      return -1;
+    }
+    ssize_t ret = 0;
+    do {
+      ret = ::pwrite(fd_, data, size, offset);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+  }
+
+  // 读取 size 字节，data 和 offset 必须对齐，size 可以不对齐。
+  // 返回读到的字节数，到达文件末尾时少于 size，出错返回 -1。
+  ssize_t read_all(off_t offset, void* data, std::size_t size) {
+    std::uint8_t* p = static_cast<std::uint8_t*>(data);
+    std::size_t body = aligned_buffer::align_down(size, alignment_);
+    std::size_t done = 0;
+    while (done < body) {
+      ssize_t ret = read_at(offset + done, p + done, body - done);
+      if (ret < 0) {
+        return -1;
+      }
+      done += static_cast<std::size_t>(ret);
+      // 文件末尾不足一块时 pread 返回的长度可能不对齐。
+      if (ret == 0 || done % alignment_ != 0) {
+        return static_cast<ssize_t>(done < size ? done : size);
+      }
+    }
+
+    if (body < size) {
+      aligned_buffer block(alignment_, alignment_);
+      ssize_t ret = read_at(offset + body, block.data(), alignment_);
+      if (ret < 0) {
+        return -1;
+      }
+      std::size_t tail = size - body;
+      std::size_t count = static_cast<std::size_t>(ret) < tail ? static_cast<std::size_t>(ret) : tail;
+      std::memcpy(p + body, block.data(), count);
+      done += count;
+    }
+    return static_cast<ssize_t>(done);
+  }
+
+  // 写入 size 字节，data 和 offset 必须对齐，size 可以不对齐。
+  // 尾部先读出所在的块再覆盖写回，不破坏之后的内容；写到文件末尾之后按实际长度截断。
+  bool write_all(off_t offset, const void* data, std::size_t size) {
+    const std::uint8_t* p = static_cast<const std::uint8_t*>(data);
+    std::size_t body = aligned_buffer::align_down(size, alignment_);
+    std::size_t done = 0;
+    while (done < body) {
+      ssize_t ret = write_at(offset + done, p + done, body - done);
+      if (ret <= 0) {
+        return false;
+      }
+      done += static_cast<std::size_t>(ret);
+    }
+    if (body == size) {
+      return true;
+    }
+
+    off_t old_size = this->size();
+    if (old_size < 0) {
+      return false;
+    }
+    aligned_buffer block(alignment_, alignment_);
+    off_t block_offset = offset + static_cast<off_t>(body);
+    ssize_t ret = 0;
+    if (block_offset < old_size) {
+      ret = read_at(block_offset, block.data(), alignment_);
+      if (ret < 0) {
+        return false;
+      }
+    }
+    std::memset(block.data() + ret, 0, alignment_ - static_cast<std::size_t>(ret));
+    std::memcpy(block.data(), p + body, size - body);
+    if (write_at(block_offset, block.data(), alignment_) != static_cast<ssize_t>(alignment_)) {
+      return false;
+    }
+
+    off_t end = offset + static_cast<off_t>(size);
+    return truncate(end > old_size ? end : old_size);
+  }
+
+  bool truncate(off_t size) {
+    return ::ftruncate(fd_, size) == 0;
+  }
+
+  std::size_t get_alignment() const { return alignment_; }
+  bool is_direct() const { return direct_; }
+
+private:
+  bool is_aligned(off_t offset, const void* data, std::size_t size) const {
+    return aligned_buffer::is_aligned(data, alignment_) &&
+        (static_cast<std::size_t>(offset) & (alignment_ - 1)) == 0 &&
+        (size & (alignment_ - 1)) == 0;
+  }
+
+private:
+  std::size_t alignment_;
+  bool direct_;
+};
+
+enum struct map_mode {
+  read_only,
+  // 共享映射，修改写回文件。
+  read_write
+};
+
+enum struct map_advice {
+  normal,
+  sequential,
+  random,
+  willneed,
+  dontneed,
+  // 透明大页，需要内核支持文件映射的大页。
+  hugepage
+};
+
+// 内存映射文件。
+// 可以映射整个文件，也可以只映射一个窗口，超大文件按窗口依次重新映射，控制占用的地址空间。
+// 只读映射的页面来自页缓存，多个进程映射同一个文件时共享物理内存。
+class mapped_file {
+public:
+  mapped_file()
+    : mode_(map_mode::read_only),
+      base_(nullptr),
+      base_length_(0),
+      window_offset_(0),
+      window_length_(0) {}
+
+  mapped_file(const std::string& file_path, map_mode mode = map_mode::read_only)
+    : mapped_file() {
+    if (open(file_path, mode)) {
+      map();
+    }
+  }
+
+  mapped_file(const mapped_file&) = delete;
+  mapped_file& operator=(const mapped_file&) = delete;
+
+  ~mapped_file() {
+    close();
+  }
+
+  // 打开文件但不映射。读写模式下文件不存在时创建，size 不为 0 时调整文件大小。
+  bool open(const std::string& file_path, map_mode mode = map_mode::read_only, std::uint64_t size = 0) {
+    close();
+    mode_ = mode;
+    int flags = mode == map_mode::read_only ? O_RDONLY : (O_RDWR | O_CREAT);
+    if (!file_.open(file_path, flags)) {
+      return false;
+    }
+    if (size != 0 && !resize(size)) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+    unmap();
+    file_.close();
+  }
+
+  // 映射 [offset, offset + length)，length 为 0 时映射到文件末尾。
+  // offset 不需要按页对齐，data() 指向 offset 处。
+  bool map(std::uint64_t offset = 0, std::size_t length = 0) {
+    unmap();
+    std::uint64_t total = get_file_size();
+    if (!file_.is_valid() || offset > total) {
+      return false;
+    }
+    if (length == 0 || offset + length > total) {
+      length = static_cast<std::size_t>(total - offset);
+    }
+    if (length == 0) {
+      return true;
+    }
+
+    std::uint64_t aligned = offset & ~static_cast<std::uint64_t>(page_size() - 1);
+    std::size_t adjust = static_cast<std::size_t>(offset - aligned);
+    int protection = mode_ == map_mode::read_only ? PROT_READ : (PROT_READ | PROT_WRITE);
+    void* address = ::mmap(nullptr, length + adjust, protection, MAP_SHARED,
+        file_.get_fd(), static_cast<off_t>(aligned));
+    if (address == MAP_FAILED) {
+      CALF_LOG(error) << "mapped file mmap failed with error " << errno;
+      return false;
+    }
+
+    base_ = static_cast<std::uint8_t*>(address);
+    base_length_ = length + adjust;
+    window_offset_ = offset;
+    window_length_ = length;
+    return true;
+  }
+
+  // 映射下一个窗口，返回 false 表示已经到达文件末尾。
+  bool map_next(std::size_t length) {
+    std::uint64_t offset = window_offset_ + window_length_;
+    if (offset >= get_file_size()) {
+      unmap();
+      return false;
+    }
+    return map(offset, length);
+  }
+
+  void unmap() {
+    if (base_ != nullptr) {
+      ::munmap(base_, base_length_);
+      base_ = nullptr;
+      base_length_ = 0;
+    }
+    window_length_ = 0;
+  }
+
+  // 调整文件大小，已有的映射会失效，需要重新 map。
+  bool resize(std::uint64_t size) {
+    unmap();
+    return ::ftruncate(file_.get_fd(), static_cast<off_t>(size)) == 0;
+  }
+
+  // 对窗口内的范围给出访问提示，length 为 0 时到窗口末尾。
+  bool advise(map_advice advice, std::size_t offset = 0, std::size_t length = 0) {
+    void* address = nullptr;
+    std::size_t range = 0;
+    if (!get_page_range(offset, length, &address, &range)) {
+      return false;
+    }
+    return ::madvise(address, range, get_advice(advice)) == 0;
+  }
+
+  // 把窗口内修改过的页面写回文件，async 为 true 时只发起写回不等待。
+  bool sync(std::size_t offset = 0, std::size_t length = 0, bool async = false) {
+    void* address = nullptr;
+    std::size_t range = 0;
+    if (!get_page_range(offset, length, &address, &range)) {
+      return false;
+    }
+    return ::msync(address, range, async ? MS_ASYNC : MS_SYNC) == 0;
+  }
+
+  std::uint8_t* data() { return base_ != nullptr ? base_ + (base_length_ - window_length_) : nullptr; }
+  const std::uint8_t* data() const { return base_ != nullptr ? base_ + (base_length_ - window_length_) : nullptr; }
+  // 当前窗口的长度和在文件中的偏移。
+  std::size_t size() const { return window_length_; }
+  std::uint64_t offset() const { return window_offset_; }
+  bool is_mapped() const { return base_ != nullptr; }
+
+  std::uint64_t get_file_size() {
+    off_t size = file_.size();
+    return size > 0 ? static_cast<std::uint64_t>(size) : 0;
+  }
+
+  file& get_file() { return file_; }
+
+  static std::size_t page_size() {
+    static const std::size_t size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return size;
+  }
+
+private:
+  // 窗口内的范围扩展到页边界。
+  bool get_page_range(std::size_t offset, std::size_t length, void** address, std::size_t* range) {
+    if (base_ == nullptr || offset > window_length_) {
+      return false;
+    }
+    if (length == 0 || offset + length > window_length_) {
+      length = window_length_ - offset;
+    }
+    std::size_t begin = (base_length_ - window_length_) + offset;
+    std::size_t aligned = begin & ~(page_size() - 1);
+    *address = base_ + aligned;
+    *range = begin + length - aligned;
+    return true;
+  }
+
+  static int get_advice(map_advice advice) {
+    switch (advice) {
+    case map_advice::sequential:
+      return MADV_SEQUENTIAL;
+    case map_advice::random:
+      return MADV_RANDOM;
+    case map_advice::willneed:
+      return MADV_WILLNEED;
+    case map_advice::dontneed:
+      return MADV_DONTNEED;
+    case map_advice::hugepage:
+#ifdef MADV_HUGEPAGE
+      return MADV_HUGEPAGE;
+#else
+      return MADV_NORMAL;
+#endif
+    default:
+      return MADV_NORMAL;
+    }
+  }
+
+private:
+  file file_;
+  map_mode mode_;
+  std::uint8_t* base_;
+  std::size_t base_length_;
+  std::uint64_t window_offset_;
+  std::size_t window_length_;
+};
+
+// 文件写入队列，合并多个生产者的写入，并记录等待落盘的回调。
+// file_channel 和 io_uring 版本的 completion_file_channel 共用。
+// 追加接口返回 true 表示队列原本空闲，调用者负责安排一次处理，处理者循环 take 直到返回 false。
+class file_write_queue {
+public:
+  using sync_handler = std::function<void(bool success)>;
+
+  struct batch {
+    batch() : offset(0) {}
+
+    buffer_chain chain;
+    // chain 在文件中的起始位置。
+    std::uint64_t offset;
+    // 本批数据写完后需要落盘，再逐个通知。
+    std::vector<sync_handler> waiters;
+  };
+
+public:
+  explicit file_write_queue(std::uint64_t offset = 0)
+    : queued_(offset), taken_(offset), busy_(false) {}
+
+  // end 返回追加后的文件末尾位置。
+  bool push(const void* data, std::size_t size, std::uint64_t* end = nullptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.append(data, size);
+    return pushed(size, end);
+  }
+
+  bool push(pooled_buffer&& buffer, std::uint64_t* end = nullptr) {
+    std::size_t size = buffer.size();
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.append(std::move(buffer));
+    return pushed(size, end);
+  }
+
+  bool push(const shared_buffer& buffer, std::size_t offset, std::size_t size, std::uint64_t* end = nullptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.append(buffer, offset, size);
+    return pushed(size, end);
+  }
+
+  // 等待此前追加的数据全部落盘。
+  bool push_sync(sync_handler handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    waiters_.push_back(std::move(handler));
+    return pushed(0, nullptr);
+  }
+
+  // 取出积压的全部数据和等待者，队列为空时清除忙标志并返回 false。
+  bool take(batch& out) {
+    out.chain.clear();
+    out.waiters.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pending_.empty() && waiters_.empty()) {
+      busy_ = false;
+      idle_cv_.notify_all();
+      return false;
+    }
+    out.offset = taken_;
+    taken_ += pending_.size();
+    out.chain.swap(pending_);
+    out.waiters.swap(waiters_);
+    return true;
+  }
+
+  // 等待所有追加的数据处理完。
+  void wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this]() { return !busy_; });
+  }
+
+  bool is_busy() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return busy_;
+  }
+
+  // 已追加数据的末尾位置。
+  std::uint64_t get_queued_bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queued_;
+  }
+
+private:
+  bool pushed(std::size_t size, std::uint64_t* end) {
+    queued_ += size;
+    if (end != nullptr) {
+      *end = queued_;
+    }
+    if (busy_) {
+      return false;
+    }
+    busy_ = true;
+    return true;
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable idle_cv_;
+  buffer_chain pending_;
+  std::vector<sync_handler> waiters_;
+  std::uint64_t queued_;
+  std::uint64_t taken_;
+  bool busy_;
+};
+
+// 文件 IO 线程，在后台执行阻塞的文件写入和落盘。
+// stop 会先执行完已经投递的任务再退出，之前写入的数据不会丢失。
+class file_io_service {
+public:
+  using task_t = std::function<void(void)>;
+
+public:
+  file_io_service() : running_(ATOMIC_VAR_INIT(false)), quit_flag_(false) {}
+
+  ~file_io_service() {
+    stop();
+  }
+
+  file_io_service(const file_io_service&) = delete;
+  file_io_service& operator=(const file_io_service&) = delete;
+
+  void start() {
+    if (thread_.joinable()) {
+      return;
+    }
+    quit_flag_ = false;
+    running_.store(true, std::memory_order_release);
+    thread_ = std::thread(&file_io_service::run_loop, this);
+  }
+
+  void stop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    quit_flag_ = true;
+    lock.unlock();
+    cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  bool is_running() const {
+    return running_.load(std::memory_order_acquire);
+  }
+
+  void post(task_t task) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    tasks_.emplace_back(std::move(task));
+    lock.unlock();
+    cv_.notify_one();
+  }
+
+  template<typename Fn, typename ...Args>
+  void dispatch(Fn&& fn, Args&&... args) {
+    post(std::bind(std::forward<Fn>(fn), std::forward<Args>(args)...));
+  }
+
+private:
+  void run_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      cv_.wait(lock, [this]() { return !tasks_.empty() || quit_flag_; });
+      if (tasks_.empty()) {
+        break;
+      }
+      running_tasks_.swap(tasks_);
+      lock.unlock();
+
+      time::loop_clock::update();
+      for (auto& task : running_tasks_) {
+        task();
+      }
+      running_tasks_.clear();
+      lock.lock();
+    }
+    running_.store(false, std::memory_order_release);
+    time::loop_clock::reset();
+  }
+
+private:
+  std::thread thread_;
+  std::atomic_bool running_;
+  bool quit_flag_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<task_t> tasks_;
+  std::vector<task_t> running_tasks_;
+};
+
+struct file_channel_options {
+  // 打开时截断文件，否则从文件末尾继续写入。
+  bool truncate = false;
+  mode_t mode = 0644;
+};
+
+// 异步文件通道，与 Windows 版本的 file_channel 对应。
+// 任意线程调用 write 只把数据追加到待写队列，由 file_io_service 线程合并成大块 pwritev 顺序写入。
+// sync 等待此前写入的数据落盘，同一批的多个等待者共用一次 fdatasync（组提交）。
+// 回调都在 IO 线程中执行。
+class file_channel {
+public:
+  using file_handler = std::function<void(file_channel& channel)>;
+  using sync_handler = file_write_queue::sync_handler;
+
+public:
+  file_channel(
+      const std::string& file_path,
+      file_io_service& io_service,
+      const file_handler& handler = file_handler(),
+      const file_channel_options& options = file_channel_options())
+    : io_service_(io_service),
+      handler_(handler),
+      queue_(open(file_path, options)),
+      written_(queue_.get_queued_bytes()),
+      durable_(queue_.get_queued_bytes()),
+      type_(io_type::open),
+      error_(0),
+      token_(std::make_shared<file_channel*>(this)) {}
+
+  file_channel(const file_channel&) = delete;
+  file_channel& operator=(const file_channel&) = delete;
+
+  ~file_channel() {
+    close();
+  }
+
+  bool is_valid() { return file_.is_valid(); }
+
+  // 以下写入接口返回写入后的文件末尾位置，与 get_durable_bytes 比较可以判断是否已经落盘。
+  std::uint64_t write(const std::uint8_t* data, std::size_t size) {
+    std::uint64_t end = 0;
+    if (queue_.push(data, size, &end)) {
+      schedule();
+    }
+    return end;
+  }
+
+  std::uint64_t write(const std::string& data) {
+    return write(reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+  }
+
+  // 接管缓存区，不拷贝内容。
+  std::uint64_t write(io_buffer& buffer) {
+    std::uint64_t end = 0;
+    if (queue_.push(std::move(buffer), &end)) {
+      schedule();
+    }
+    return end;
+  }
+
+  std::uint64_t write(const shared_buffer& buffer) {
+    std::uint64_t end = 0;
+    if (queue_.push(buffer, 0, buffer->size(), &end)) {
+      schedule();
+    }
+    return end;
+  }
+
+  // 此前写入的数据全部落盘后回调，失败时参数为 false。
+  void sync(sync_handler handler) {
+    if (queue_.push_sync(std::move(handler))) {
+      schedule();
+    }
+  }
+
+  std::future<bool> sync() {
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = promise->get_future();
+    sync([promise](bool success) {
+      promise->set_value(success);
+    });
+    return result;
+  }
+
+  // 等待已经写入的数据处理完再关闭文件，不会自动落盘。
+  // IO 线程没有运行时在当前线程写完，此时不能与 file_io_service::start 并发调用。
+  // 之后令牌失效，留在 file_io_service 队列中的任务不再访问通道。
+  void close() {
+    if (io_service_.is_running()) {
+      queue_.wait_idle();
+    } else if (queue_.is_busy()) {
+      flush();
+    }
+    token_.reset();
+    file_.close();
+  }
+
+  // 已经写入文件和已经落盘的位置。
+  std::uint64_t get_written_bytes() const { return written_.load(std::memory_order_acquire); }
+  std::uint64_t get_durable_bytes() const { return durable_.load(std::memory_order_acquire); }
+
+  io_type get_type() const { return type_; }
+  int get_error() const { return error_; }
+
+private:
+  std::uint64_t open(const std::string& file_path, const file_channel_options& options) {
+    int flags = O_WRONLY | O_CREAT | (options.truncate ? O_TRUNC : 0);
+    if (!file_.open(file_path, flags, options.mode)) {
+      CALF_LOG(error) << "file channel open failed with error " << errno;
+      return 0;
+    }
+    off_t size = file_.size();
+    return size > 0 ? static_cast<std::uint64_t>(size) : 0;
+  }
+
+  void schedule() {
+    std::weak_ptr<file_channel*> token = token_;
+    io_service_.post([token]() {
+      std::shared_ptr<file_channel*> channel = token.lock();
+      if (channel) {
+        (*channel)->flush();
+      }
+    });
+  }
+
+  // 在 IO 线程中执行，处理到队列为空为止。
+  void flush() {
+    file_write_queue::batch batch;
+    while (queue_.take(batch)) {
+      bool success = error_ == 0 && write_batch(batch);
+      if (batch.waiters.empty()) {
+        continue;
+      }
+      std::uint64_t written = written_.load(std::memory_order_relaxed);
+      if (success && durable_.load(std::memory_order_relaxed) < written) {
+        if (file_.datasync()) {
+          durable_.store(written, std::memory_order_release);
+        } else {
+          broken(errno);
+          success = false;
+        }
+      }
+      for (auto& waiter : batch.waiters) {
+        waiter(success);
+      }
+    }
+  }
+
+  bool write_batch(file_write_queue::batch& batch) {
+    iovec iov[IOV_MAX];
+    std::uint64_t offset = batch.offset;
+    while (!batch.chain.empty()) {
+      int count = 0;
+      for (auto& slice : batch.chain) {
+        iov[count].iov_base = const_cast<std::uint8_t*>(slice.data());
+        iov[count].iov_len = slice.size;
+        if (++count == IOV_MAX) {
+          break;
+        }
+      }
+
+      ssize_t ret = ::pwritev(file_.get_fd(), iov, count, static_cast<off_t>(offset));
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        broken(errno);
+        return false;
+      }
+      offset += static_cast<std::uint64_t>(ret);
+      batch.chain.consume(static_cast<std::size_t>(ret));
+      written_.store(offset, std::memory_order_release);
+    }
+    return true;
+  }
+
+  void broken(int err) {
+    if (error_ != 0) {
+      return;
+    }
+    CALF_LOG(error) << "file channel write failed with error " << err;
+    error_ = err;
+    type_ = io_type::broken;
+    if (handler_) {
+      handler_(*this);
+    }
+  }
+
+private:
+  file_io_service& io_service_;
+  file_handler handler_;
+  file file_;
+  file_write_queue queue_;
+  std::atomic<std::uint64_t> written_;
+  std::atomic<std::uint64_t> durable_;
+  io_type type_;
+  int error_;
+  // 投递给 IO 线程的任务持有弱引用，关闭后不再执行。
+  std::shared_ptr<file_channel*> token_;
+};
+
+struct stream_reader_options {
+  stream_reader_options()
+    : buffer_size(1024 * 1024),
+      depth(4),
+      direct(false),
+      offset(0),
+      length(UINT64_MAX) {}
+
+  // 每个缓存区的大小，向上对齐到 4KB。
+  std::size_t buffer_size;
+  // 缓存区个数，包括消费者正在使用的一个。
+  std::size_t depth;
+  // 以 O_DIRECT 读取，不占用页缓存，offset 必须对齐。
+  bool direct;
+  // 起始偏移和读取长度，默认读到文件末尾。
+  std::uint64_t offset;
+  std::uint64_t length;
+};
+
+// 顺序读取文件，后台线程沿 depth 个缓存区组成的环提前读取，磁盘读取和消费者处理并行进行。
+// next 返回下一个已读满的缓存区，数据不再复制，在下一次调用 next 或 close 之前有效。
+// 只能由一个消费者线程使用。
+class stream_reader {
+public:
+  struct span {
+    span() : data(nullptr), size(0), offset(0) {}
+
+    const std::uint8_t* data;
+    std::size_t size;
+    // 数据在文件中的偏移。
+    std::uint64_t offset;
+  };
+
+public:
+  stream_reader()
+    : produced_(0),
+      consumed_(0),
+      holding_(false),
+      finished_(false),
+      quit_flag_(false),
+      error_(0),
+      read_bytes_(0) {}
+
+  stream_reader(const std::string& file_path, const stream_reader_options& options = stream_reader_options())
+    : stream_reader() {
+    open(file_path, options);
+  }
+
+  ~stream_reader() {
+    close();
+  }
+
+  stream_reader(const stream_reader&) = delete;
+  stream_reader& operator=(const stream_reader&) = delete;
+
+  bool open(const std::string& file_path, const stream_reader_options& options = stream_reader_options()) {
+    close();
+    options_ = options;
+    if (options_.depth < 2) {
+      options_.depth = 2;
+    }
+    if (options_.direct) {
+      if (!direct_file_.open(file_path, O_RDONLY)) {
+        return false;
+      }
+    } else {
+      if (!file_.open(file_path, O_RDONLY)) {
+        return false;
+      }
+      ::posix_fadvise(file_.get_fd(), static_cast<off_t>(options_.offset), 0, POSIX_FADV_SEQUENTIAL);
+    }
+
+    std::size_t alignment = options_.direct ? direct_file_.get_alignment() : aligned_buffer::default_alignment;
+    options_.buffer_size = aligned_buffer::align_up(
+        options_.buffer_size == 0 ? alignment : options_.buffer_size, alignment);
+    slots_.clear();
+    for (std::size_t i = 0; i < options_.depth; ++i) {
+      slots_.emplace_back(options_.buffer_size, alignment);
+    }
+    offsets_.assign(slots_.size(), 0);
+
+    produced_ = consumed_ = 0;
+    holding_ = finished_ = quit_flag_ = false;
+    error_ = 0;
+    read_bytes_ = 0;
+    thread_ = std::thread(&stream_reader::read_loop, this);
+    return true;
+  }
+
+  // 取下一个缓存区，同时归还上一次取得的缓存区。读完或出错时返回 false。
+  bool next(span& out) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (holding_) {
+      holding_ = false;
+      ++consumed_;
+      free_cv_.notify_one();
+    }
+    filled_cv_.wait(lock, [this]() { return produced_ > consumed_ || finished_; });
+    if (produced_ == consumed_ || quit_flag_) {
+      return false;
+    }
+    aligned_buffer& buffer = slots_[consumed_ % slots_.size()];
+    holding_ = true;
+    out.data = buffer.data();
+    out.size = buffer.size();
+    out.offset = offsets_[consumed_ % slots_.size()];
+    return true;
+  }
+
+  // 停止后台读取并关闭文件，之前返回的数据失效。
+  void close() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    quit_flag_ = true;
+    lock.unlock();
+    free_cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    file_.close();
+    direct_file_.close();
+  }
+
+  // 读取出错时的错误码，正常读完为 0。
+  int get_error() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return error_;
+  }
+
+  // 后台已经读取的字节数。
+  std::uint64_t get_read_bytes() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return read_bytes_;
+  }
+
+  std::size_t get_buffer_size() const { return options_.buffer_size; }
+  std::size_t get_depth() const { return options_.depth; }
+
+private:
+  void read_loop() {
+    std::uint64_t offset = options_.offset;
+    std::uint64_t end = options_.length > UINT64_MAX - offset ? UINT64_MAX : offset + options_.length;
+    int err = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (offset < end) {
+      free_cv_.wait(lock, [this]() { return produced_ - consumed_ < slots_.size() || quit_flag_; });
+      if (quit_flag_) {
+        break;
+      }
+      std::size_t index = produced_ % slots_.size();
+      lock.unlock();
+
+      // 缓存区不在消费者手中，读取时不持有锁。
+      aligned_buffer& buffer = slots_[index];
+      std::uint64_t remain = end - offset;
+      std::size_t size = remain < options_.buffer_size ? static_cast<std::size_t>(remain) : options_.buffer_size;
+      buffer.resize(options_.buffer_size);
+      ssize_t ret = read_block(offset, buffer.data(), size);
+      if (ret < 0) {
+        err = errno;
+      } else {
+        buffer.resize(static_cast<std::size_t>(ret));
+        offsets_[index] = offset;
+        offset += static_cast<std::uint64_t>(ret);
+      }
+
+      lock.lock();
+      if (ret <= 0) {
+        break;
+      }
+      ++produced_;
+      read_bytes_ += static_cast<std::uint64_t>(ret);
+      filled_cv_.notify_one();
+      if (static_cast<std::size_t>(ret) < size) {
+        break;
+      }
+    }
+    error_ = err;
+    finished_ = true;
+    filled_cv_.notify_one();
+  }
+
+  // 读满 size 字节，到达文件末尾时返回实际读到的长度。
+  ssize_t read_block(std::uint64_t offset, std::uint8_t* data, std::size_t size) {
+    if (options_.direct) {
+      return direct_file_.read_all(static_cast<off_t>(offset), data, size);
+    }
+    std::size_t done = 0;
+    while (done < size) {
+      ssize_t ret = ::pread(file_.get_fd(), data + done, size - done, static_cast<off_t>(offset + done));
+      if (ret < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return -1;
+      }
+      if (ret == 0) {
+        break;
+      }
+      done += static_cast<std::size_t>(ret);
+    }
+    return static_cast<ssize_t>(done);
+  }
+
+private:
+  stream_reader_options options_;
+  file file_;
+  direct_file direct_file_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable free_cv_;
+  std::condition_variable filled_cv_;
+  std::vector<aligned_buffer> slots_;
+  std::vector<std::uint64_t> offsets_;
+  std::uint64_t produced_;
+  std::uint64_t consumed_;
+  bool holding_;
+  bool finished_;
+  bool quit_flag_;
+  int error_;
+  std::uint64_t read_bytes_;
+};
+
+namespace logging {
+
+using calf::logging::log_target;
+using calf::logging::log_record;
+using calf::logging::log_format;
+using calf::logging::log_string;
+
+struct log_file_options {
+  // 结构化记录的编码格式。
+  log_format format = log_format::text;
+  // 单个文件达到该大小后轮转，0 表示不按大小轮转。
+  std::size_t rotate_size = 0;
+  // 距离打开文件超过该时间后轮转，0 表示不按时间轮转。
+  std::chrono::seconds rotate_interval{0};
+  // fdatasync 周期，0 表示只在 sync() 时落盘。
+  std::chrono::milliseconds sync_interval{0};
+  // 后台线程最长等待时间。
+  std::chrono::milliseconds flush_interval{100};
+  // 积压达到该字节数时立即唤醒后台线程。
+  std::size_t flush_bytes = 1024 * 1024;
+};
+
+struct log_file_stats {
+  std::uint64_t total_bytes;
+  std::uint64_t total_records;
+  // 文件无法打开或写入失败时丢弃的记录数。
+  std::uint64_t dropped_records;
+  double bytes_per_second;
+  double records_per_second;
+};
+
+// 文件日志输出目标。
+// 写入线程在线程局部缓存中编码，再把字节追加到连续的待写缓存，由后台线程交换缓存后批量写入、
+// 轮转和落盘，所以轮转和 fdatasync 都不会阻塞写入线程，稳定后编码和排队都不再分配内存。
+// 文件打开失败时后台线程在之后每一轮写入前重新打开，期间的记录被丢弃并计入 dropped_records。
+class log_file_target
+  : public log_target {
+public:
+  log_file_target(
+      const std::string& file_name,
+      const log_file_options& options = log_file_options())
+    : file_name_(file_name),
+      options_(options),
+      flush_requested_(0),
+      flushed_(0),
+      quit_flag_(false),
+      file_size_(0),
+      total_bytes_(0),
+      total_records_(0),
+      dropped_records_(0),
+      bytes_per_second_(0),
+      records_per_second_(0) {
+    open_file();
+    thread_ = std::thread(&log_file_target::flush_loop, this);
+  }
+
+  ~log_file_target() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    quit_flag_ = true;
+    cv_.notify_one();
+    lock.unlock();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  void output(const log_string& data) override {
+    std::string& buffer = encode_buffer();
+    calf::logging::append_utf8(buffer, data.data(), data.size());
+    append(buffer);
+  }
+
+  void write(log_record&& record) override {
+    std::string& buffer = encode_buffer();
+    calf::logging::encode(record, options_.format, buffer);
+    append(buffer);
+  }
+
+  // 追加一条已经编码为 UTF-8 的记录。
+  void append(const std::string& record) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    pending_.append(record);
+    pending_ends_.push_back(pending_.size());
+    if (pending_.size() >= options_.flush_bytes) {
+      cv_.notify_one();
+    }
+  }
+
+  // 等待已提交的记录全部写入并落盘。
+  void sync() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::uint64_t seq = ++flush_requested_;
+    cv_.notify_one();
+    flushed_cv_.wait(lock, [this, seq]() -> bool {
+      return flushed_ >= seq || quit_flag_;
+    });
+  }
+
+  log_file_stats get_stats() {
+    log_file_stats stats;
+    stats.total_bytes = total_bytes_.load(std::memory_order_relaxed);
+    stats.total_records = total_records_.load(std::memory_order_relaxed);
+    stats.dropped_records = dropped_records_.load(std::memory_order_relaxed);
+    stats.bytes_per_second = bytes_per_second_.load(std::memory_order_relaxed);
+    stats.records_per_second = records_per_second_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  bool is_open() { return file_.is_valid(); }
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  // 每个写入线程复用的编码缓存。
+  static std::string& encode_buffer() {
+    thread_local std::string buffer;
+    buffer.clear();
+    return buffer;
+  }
+
+  void flush_loop() {
+    std::string batch;
+    std::vector<std::size_t> batch_ends;
+    clock::time_point last_sync = clock::now();
+    clock::time_point window_start = last_sync;
+    std::uint64_t window_bytes = 0;
+    std::uint64_t window_records = 0;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      cv_.wait_for(lock, options_.flush_interval, [this]() -> bool {
+        return quit_flag_ ||
+            pending_.size() >= options_.flush_bytes ||
+            flush_requested_ > flushed_;
+      });
+
+      // 交换缓存，两组缓存轮流使用，容量得以复用。
+      batch.swap(pending_);
+      batch_ends.swap(pending_ends_);
+      std::uint64_t requested = flush_requested_;
+      bool quit = quit_flag_;
+      lock.unlock();
+
+      std::size_t records = 0;
+      std::size_t bytes = 0;
+      if (!batch_ends.empty() && (file_.is_valid() || open_file())) {
+        bytes = write_batch(batch, batch_ends, records);
+      }
+      if (records < batch_ends.size()) {
+        dropped_records_.fetch_add(batch_ends.size() - records, std::memory_order_relaxed);
+      }
+      batch.clear();
+      batch_ends.clear();
+
+      clock::time_point now = clock::now();
+      bool sync_due = options_.sync_interval.count() > 0 &&
+          now - last_sync >= options_.sync_interval;
+      if (file_.is_valid() && (requested > flushed_ || sync_due)) {
+        file_.datasync();
+        last_sync = now;
+      }
+      rotate_if_needed(now);
+
+      total_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+      total_records_.fetch_add(records, std::memory_order_relaxed);
+      window_bytes += bytes;
+      window_records += records;
+      std::chrono::duration<double> elapsed = now - window_start;
+      if (elapsed.count() >= 1.0) {
+        bytes_per_second_.store(window_bytes / elapsed.count(), std::memory_order_relaxed);
+        records_per_second_.store(window_records / elapsed.count(), std::memory_order_relaxed);
+        window_start = now;
+        window_bytes = 0;
+        window_records = 0;
+      }
+
+      lock.lock();
+      flushed_ = requested;
+      flushed_cv_.notify_all();
+      if (quit && pending_.empty()) {
+        break;
+      }
+    }
+  }
+
+  // 按记录边界每 IOV_MAX 条分段写入，每段之后检查轮转，避免单个文件超出轮转大小太多。
+  // records 返回写入的记录数，写入失败时关闭文件，剩余记录由调用方计为丢弃，下一轮重新打开。
+  std::size_t write_batch(std::string& batch, const std::vector<std::size_t>& ends, std::size_t& records) {
+    std::size_t total = 0;
+    records = 0;
+    for (std::size_t begin = 0; begin < ends.size() && file_.is_valid(); ) {
+      std::size_t end = std::min(ends.size(), begin + static_cast<std::size_t>(IOV_MAX));
+      std::size_t offset = begin > 0 ? ends[begin - 1] : 0;
+      std::size_t bytes = ends[end - 1] - offset;
+      iovec iov;
+      iov.iov_base = &batch[offset];
+      iov.iov_len = bytes;
+      if (!file_.write_all(&iov, 1)) {
+        CALF_LOG_RATE(error, 1) << "log file " << file_name_ << " write failed with error " << errno;
+        file_.close();
+        break;
+      }
+      file_size_ += bytes;
+      total += bytes;
+      records += end - begin;
+      begin = end;
+      rotate_if_needed(clock::now());
+    }
+    return total;
+  }
+
+  // 文件未打开时不轮转，由下一轮写入前重新打开。
+  void rotate_if_needed(clock::time_point now) {
+    if (!file_.is_valid()) {
+      return;
+    }
+    bool by_size = options_.rotate_size > 0 && file_size_ >= options_.rotate_size;
+    bool by_time = options_.rotate_interval.count() > 0 &&
+        now - opened_at_ >= options_.rotate_interval;
+    if (!by_size && !by_time) {
+      return;
+    }
+
+    // 开启了落盘周期时，旧文件关闭前先落盘。
+    if (options_.sync_interval.count() > 0) {
+      file_.datasync();
+    }
+    std::string rotated = rotated_file_name();
+    if (::rename(file_name_.c_str(), rotated.c_str()) != 0) {
+      CALF_LOG_RATE(error, 1) << "log file " << file_name_ << " rotate failed with error " << errno;
+      return;
+    }
+    open_file();
+  }
+
+  // 失败时记录错误，后台线程在下一轮写入前重试。
+  bool open_file() {
+    opened_at_ = clock::now();
+    if (!file_.open(file_name_, O_WRONLY | O_CREAT | O_APPEND)) {
+      CALF_LOG_RATE(error, 1) << "log file " << file_name_ << " open failed with error " << errno;
+      file_size_ = 0;
+      return false;
+    }
+    off_t size = file_.size();
+    file_size_ = size > 0 ? static_cast<std::size_t>(size) : 0;
+    return true;
+  }
+
+  // 轮转文件名：<file_name>.<YYYYmmdd-HHMMSS>[.n]
+  std::string rotated_file_name() {
+    std::time_t t = std::time(nullptr);
+    std::tm tm_now;
+    ::localtime_r(&t, &tm_now);
+    char suffix[32] = { 0 };
+    std::strftime(suffix, sizeof(suffix), ".%Y%m%d-%H%M%S", &tm_now);
+
+    std::string name = file_name_ + suffix;
+    std::string result = name;
+    struct stat st;
+    for (int n = 1; ::stat(result.c_str(), &st) == 0; ++n) {
+      result = name + "." + std::to_string(n);
+    }
+    return result;
+  }
+
+private:
+  std::string file_name_;
+  log_file_options options_;
+  file file_;
+
+  // 待写记录连续存放，pending_ends_ 为每条记录的结束位置。
+  std::string pending_;
+  std::vector<std::size_t> pending_ends_;
+  std::uint64_t flush_requested_;
+  std::uint64_t flushed_;
+  bool quit_flag_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::condition_variable flushed_cv_;
+
+  // 以下仅由后台线程访问。
+  std::size_t file_size_;
+  clock::time_point opened_at_;
+
+  std::atomic<std::uint64_t> total_bytes_;
+  std::atomic<std::uint64_t> total_records_;
+  std::atomic<std::uint64_t> dropped_records_;
+  std::atomic<double> bytes_per_second_;
+  std::atomic<double> records_per_second_;
+
+  std::thread thread_;
+};
+
+} // namespace logging
+
 } // namespace linux 
 } // namespace platform 
 } // namespace calf
@@ -0,0 +1,958 @@
+// 基于 io_uring 的完成端口模型。
+//
+// 与 windows/file_io.hpp 中的 io_completion_service 对应：发起操作时提交 overlapped_io_context，
+// 完成后在 run_loop 线程中回调 io_completion_handler::io_completed 或 io_broken。
+// 直接使用系统调用和 <linux/io_uring.h>，不依赖 liburing。
+//
+// - 提交是批量的，发起的操作先写入提交队列，在下一次等待时一起提交。
+// - 支持 multishot accept/recv，一次提交持续产生完成事件，context->is_pending 表示是否还有后续事件。
+// - 支持注册文件和缓存区，以及 recv 使用的内核选择缓存区组。
+// - 可选 IORING_SETUP_SQPOLL，由内核线程轮询提交队列，提交不再需要系统调用。
+//
+#ifndef CALF_PLATFORM_LINUX_IO_COMPLETION_HPP_
+#define CALF_PLATFORM_LINUX_IO_COMPLETION_HPP_
+
+#include "posix.hpp"
+#include "file_io.hpp"
+#include "../../logging.hpp"
+#include "../../time.hpp"
+#include "../../watchdog.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace calf {
+namespace platform {
+namespace linux {
+
+class io_completion_handler;
+
+struct overlapped_io_context {
+  overlapped_io_context()
+    : completion_handler(nullptr),
+      bytes_transferred(0),
+      result(0),
+      flags(0),
+      buffer_id(-1),
+      is_pending(false),
+      type(io_type::unknown) {}
+
+  // 对应 Windows 的完成键，发起操作时设置。
+  io_completion_handler* completion_handler;
+  std::size_t bytes_transferred;
+  // 完成事件的原始结果，非负为传输字节数或新描述符。
+  int result;
+  std::uint32_t flags;
+  // 内核从缓存区组中选择的缓存区编号，没有时为 -1。
+  int buffer_id;
+  // multishot 操作还会产生后续完成事件。
+  bool is_pending;
+  io_type type;
+};
+
+class io_completion_handler {
+public:
+  virtual void io_completed(overlapped_io_context* /*context*/) {}
+  virtual void io_broken(overlapped_io_context* /*context*/, int /*err*/) {}
+  virtual ~io_completion_handler() {}
+};
+
+// io_uring 实例，管理提交队列和完成队列的内存映射。
+class io_completion_ring
+  : public file_descriptor {
+public:
+  io_completion_ring()
+    : sq_ring_(nullptr),
+      cq_ring_(nullptr),
+      sq_ring_size_(0),
+      cq_ring_size_(0),
+      sqes_(nullptr),
+      sqes_size_(0),
+      sq_head_(nullptr),
+      sq_tail_(nullptr),
+      sq_mask_(0),
+      sq_entries_(0),
+      sq_flags_(nullptr),
+      sq_array_(nullptr),
+      cq_head_(nullptr),
+      cq_tail_(nullptr),
+      cq_mask_(0),
+      cqes_(nullptr),
+      sqe_tail_(0),
+      flags_(0) {}
+
+  ~io_completion_ring() {
+    unmap();
+  }
+
+  io_completion_ring(const io_completion_ring&) = delete;
+  io_completion_ring& operator=(const io_completion_ring&) = delete;
+
+  bool create(unsigned entries, io_uring_params& params) {
+    int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return false;
+    }
+    reset(fd);
+    flags_ = params.flags;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == nullptr) {
+      return false;
+    }
+    cq_ring_ = single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+    if (cq_ring_ == nullptr || sqes_ == nullptr) {
+      unmap();
+      return false;
+    }
+
+    std::uint8_t* sq = static_cast<std::uint8_t*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sq_flags_ = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqe_tail_ = *sq_tail_;
+
+    std::uint8_t* cq = static_cast<std::uint8_t*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  // 取一个空闲的提交项，队列满时返回 nullptr。
+  io_uring_sqe* get_sqe() {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sqe_tail_ - head >= sq_entries_) {
+      return nullptr;
+    }
+    io_uring_sqe* sqe = &sqes_[sqe_tail_ & sq_mask_];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[sqe_tail_ & sq_mask_] = sqe_tail_ & sq_mask_;
+    ++sqe_tail_;
+    return sqe;
+  }
+
+  // 公布准备好的提交项并进入内核，wait_nr 为至少等待的完成事件数。
+  // 返回提交的数量，出错返回 -errno，被信号中断返回 0。
+  int submit(unsigned wait_nr) {
+    unsigned tail = *sq_tail_;
+    unsigned to_submit = sqe_tail_ - tail;
+    if (to_submit != 0) {
+      __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    }
+
+    unsigned enter_flags = 0;
+    if (flags_ & IORING_SETUP_SQPOLL) {
+      // 内核线程负责提交，只在它休眠时唤醒。
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (__atomic_load_n(sq_flags_, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+        enter_flags |= IORING_ENTER_SQ_WAKEUP;
+      }
+      if (wait_nr == 0 && enter_flags == 0) {
+        return static_cast<int>(to_submit);
+      }
+      to_submit = 0;
+    } else if (to_submit == 0 && wait_nr == 0) {
+      return 0;
+    }
+    if (wait_nr != 0) {
+      enter_flags |= IORING_ENTER_GETEVENTS;
+    }
+
+    long ret = ::syscall(__NR_io_uring_enter, fd_, to_submit, wait_nr, enter_flags, nullptr, 0);
+    if (ret < 0) {
+      return errno == EINTR ? 0 : -errno;
+    }
+    return static_cast<int>(ret);
+  }
+
+  // 只等待完成事件，不公布提交项，可以与其它线程的提交并发。
+  int wait(unsigned wait_nr) {
+    long ret = ::syscall(__NR_io_uring_enter, fd_, 0, wait_nr, IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (ret < 0) {
+      return errno == EINTR ? 0 : -errno;
+    }
+    return static_cast<int>(ret);
+  }
+
+  // 依次处理已经到达的完成事件，返回处理的数量。
+  template<typename Function>
+  unsigned for_each_cqe(Function f) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    unsigned count = 0;
+    for (; head != tail; ++head, ++count) {
+      f(cqes_[head & cq_mask_]);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return count;
+  }
+
+  int register_op(unsigned opcode, const void* arg, unsigned nr_args) {
+    long ret = ::syscall(__NR_io_uring_register, fd_, opcode, arg, nr_args);
+    return ret < 0 ? -errno : static_cast<int>(ret);
+  }
+
+  unsigned get_flags() { return flags_; }
+
+private:
+  void* map(std::size_t size, off_t offset) {
+    void* address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd_, offset);
+    return address == MAP_FAILED ? nullptr : address;
+  }
+
+  void unmap() {
+    if (sqes_ != nullptr) {
+      ::munmap(sqes_, sqes_size_);
+      sqes_ = nullptr;
+    }
+    if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+      ::munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_ != nullptr) {
+      ::munmap(sq_ring_, sq_ring_size_);
+      sq_ring_ = nullptr;
+    }
+  }
+
+private:
+  void* sq_ring_;
+  void* cq_ring_;
+  std::size_t sq_ring_size_;
+  std::size_t cq_ring_size_;
+  io_uring_sqe* sqes_;
+  std::size_t sqes_size_;
+
+  unsigned* sq_head_;
+  unsigned* sq_tail_;
+  unsigned sq_mask_;
+  unsigned sq_entries_;
+  unsigned* sq_flags_;
+  unsigned* sq_array_;
+
+  unsigned* cq_head_;
+  unsigned* cq_tail_;
+  unsigned cq_mask_;
+  io_uring_cqe* cqes_;
+
+  // 已经准备但尚未公布给内核的提交项尾部。
+  unsigned sqe_tail_;
+  unsigned flags_;
+};
+
+struct io_completion_options {
+  // 提交队列长度，完成队列为其两倍。
+  unsigned entries = 256;
+  // 启用内核提交线程。
+  bool sqpoll = false;
+  // 内核提交线程空闲多久后休眠，单位毫秒。
+  unsigned sq_thread_idle = 1000;
+  // 内核提交线程绑定的 CPU，-1 表示不绑定。
+  int sq_thread_cpu = -1;
+};
+
+// 基于 io_uring 的完成端口服务。
+// 发起操作的接口可以在任意线程调用，操作在 run_loop 下一次进入内核时批量提交；
+// 在其它线程中发起的操作会立即提交，以免 run_loop 一直阻塞。
+class io_completion_service {
+public:
+  // 使用注册文件时，fd 参数为注册表中的下标。
+  static const std::uint8_t fixed_file = IOSQE_FIXED_FILE;
+
+public:
+  io_completion_service(const io_completion_options& options = io_completion_options())
+    : quit_flag_(ATOMIC_VAR_INIT(false)),
+      loop_thread_(),
+      in_loop_(false) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    if (options.sqpoll) {
+      params.flags |= IORING_SETUP_SQPOLL;
+      params.sq_thread_idle = options.sq_thread_idle;
+      if (options.sq_thread_cpu >= 0) {
+        params.flags |= IORING_SETUP_SQ_AFF;
+        params.sq_thread_cpu = static_cast<unsigned>(options.sq_thread_cpu);
+      }
+    }
+    if (!ring_.create(options.entries, params)) {
+      CALF_LOG(error) << "io_uring_setup failed with error " << errno;
+    }
+  }
+
+  bool is_valid() { return ring_.is_valid(); }
+
+  void run_loop() {
+    loop_thread_ = std::this_thread::get_id();
+    in_loop_.store(true, std::memory_order_release);
+    heartbeat_.attach();
+    while (!quit_flag_.load(std::memory_order_relaxed)) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      int ret = ring_.submit(0);
+      lock.unlock();
+      if (ret >= 0) {
+        ret = ring_.wait(1);
+      }
+      time::loop_clock::update();
+      if (ret < 0 && ret != -EBUSY) {
+        CALF_LOG(error) << "io_uring_enter failed with error " << -ret;
+        break;
+      }
+      ring_.for_each_cqe([this](const io_uring_cqe& cqe) {
+        completed(cqe);
+      });
+    }
+    heartbeat_.detach();
+    in_loop_.store(false, std::memory_order_release);
+    time::loop_clock::reset();
+  }
+
+  // 交给 calf::watchdog 监视，完成回调执行过久时报告。
+  loop_heartbeat& get_heartbeat() {
+    return heartbeat_;
+  }
+
+  // 投递一个空操作，完成时回调 handler，可以用于跨线程唤醒。
+  bool dispatch(io_completion_handler* handler, overlapped_io_context* context) {
+    return prepare(handler, context, io_type::unknown, [](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_NOP;
+    });
+  }
+
+  void quit() {
+    quit_flag_.store(true, std::memory_order_relaxed);
+    dispatch(nullptr, nullptr);
+  }
+
+  bool read(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      void* data,
+      std::size_t size,
+      std::uint64_t offset = static_cast<std::uint64_t>(-1),
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::read, [&](io_uring_sqe* sqe) {
+      set_rw(sqe, IORING_OP_READ, fd, data, static_cast<unsigned>(size), offset, sqe_flags);
+    });
+  }
+
+  bool write(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      const void* data,
+      std::size_t size,
+      std::uint64_t offset = static_cast<std::uint64_t>(-1),
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::write, [&](io_uring_sqe* sqe) {
+      set_rw(sqe, IORING_OP_WRITE, fd, data, static_cast<unsigned>(size), offset, sqe_flags);
+    });
+  }
+
+  bool writev(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      const iovec* iov,
+      unsigned count,
+      std::uint64_t offset = static_cast<std::uint64_t>(-1),
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::write, [&](io_uring_sqe* sqe) {
+      set_rw(sqe, IORING_OP_WRITEV, fd, iov, count, offset, sqe_flags);
+    });
+  }
+
+  // 读写 register_buffers 注册过的缓存区，省去每次操作的页面映射。
+  bool read_fixed(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      void* data,
+      std::size_t size,
+      std::uint16_t buffer_index,
+      std::uint64_t offset = static_cast<std::uint64_t>(-1),
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::read, [&](io_uring_sqe* sqe) {
+      set_rw(sqe, IORING_OP_READ_FIXED, fd, data, static_cast<unsigned>(size), offset, sqe_flags);
+      sqe->buf_index = buffer_index;
+    });
+  }
+
+  bool write_fixed(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      const void* data,
+      std::size_t size,
+      std::uint16_t buffer_index,
+      std::uint64_t offset = static_cast<std::uint64_t>(-1),
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::write, [&](io_uring_sqe* sqe) {
+      set_rw(sqe, IORING_OP_WRITE_FIXED, fd, data, static_cast<unsigned>(size), offset, sqe_flags);
+      sqe->buf_index = buffer_index;
+    });
+  }
+
+  bool fsync(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      bool datasync = true,
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::write, [&](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_FSYNC;
+      sqe->fd = fd;
+      sqe->flags = sqe_flags;
+      sqe->fsync_flags = datasync ? IORING_FSYNC_DATASYNC : 0;
+    });
+  }
+
+  // multishot 为 true 时一次提交持续接受新连接，context->result 为新连接的描述符。
+  bool accept(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      bool multishot = false,
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::create, [&](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_ACCEPT;
+      sqe->fd = fd;
+      sqe->flags = sqe_flags;
+      sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+      if (multishot) {
+        sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+      }
+    });
+  }
+
+  bool connect(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      const sockaddr* addr,
+      socklen_t length,
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::open, [&](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_CONNECT;
+      sqe->fd = fd;
+      sqe->flags = sqe_flags;
+      sqe->addr = reinterpret_cast<std::uint64_t>(addr);
+      sqe->off = length;
+    });
+  }
+
+  bool recv(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      void* data,
+      std::size_t size,
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::read, [&](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_RECV;
+      sqe->fd = fd;
+      sqe->flags = sqe_flags;
+      sqe->addr = reinterpret_cast<std::uint64_t>(data);
+      sqe->len = static_cast<unsigned>(size);
+    });
+  }
+
+  // 持续接收，数据写入内核从 buffer_group 中选择的缓存区，编号见 context->buffer_id。
+  // 使用完缓存区后调用 recycle_buffer 归还。
+  bool recv_multishot(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      std::uint16_t buffer_group,
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::read, [&](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_RECV;
+      sqe->fd = fd;
+      sqe->flags = sqe_flags | IOSQE_BUFFER_SELECT;
+      sqe->ioprio |= IORING_RECV_MULTISHOT;
+      sqe->buf_group = buffer_group;
+    });
+  }
+
+  bool send(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd,
+      const void* data,
+      std::size_t size,
+      std::uint8_t sqe_flags = 0) {
+    return prepare(handler, context, io_type::write, [&](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_SEND;
+      sqe->fd = fd;
+      sqe->flags = sqe_flags;
+      sqe->addr = reinterpret_cast<std::uint64_t>(data);
+      sqe->len = static_cast<unsigned>(size);
+      sqe->msg_flags = MSG_NOSIGNAL;
+    });
+  }
+
+  bool close(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      int fd) {
+    return prepare(handler, context, io_type::close, [&](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_CLOSE;
+      sqe->fd = fd;
+    });
+  }
+
+  // 注册文件，之后以 fixed_file 标志和下标代替描述符，省去每次操作的文件引用计数。
+  bool register_files(const std::vector<int>& fds) {
+    return ring_.register_op(IORING_REGISTER_FILES, fds.data(),
+        static_cast<unsigned>(fds.size())) >= 0;
+  }
+
+  bool unregister_files() {
+    return ring_.register_op(IORING_UNREGISTER_FILES, nullptr, 0) >= 0;
+  }
+
+  // 注册缓存区，供 read_fixed、write_fixed 使用。
+  bool register_buffers(const std::vector<iovec>& buffers) {
+    return ring_.register_op(IORING_REGISTER_BUFFERS, buffers.data(),
+        static_cast<unsigned>(buffers.size())) >= 0;
+  }
+
+  bool unregister_buffers() {
+    return ring_.register_op(IORING_UNREGISTER_BUFFERS, nullptr, 0) >= 0;
+  }
+
+  // 提供 count 个大小为 size 的连续缓存区，组成供内核选择的缓存区组。
+  bool provide_buffers(
+      std::uint16_t buffer_group,
+      std::uint8_t* base,
+      std::size_t size,
+      std::uint16_t count) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    buffer_groups_[buffer_group] = buffer_group_info{ base, size };
+    lock.unlock();
+    return provide(buffer_group, base, size, count, 0);
+  }
+
+  std::uint8_t* get_buffer(std::uint16_t buffer_group, int buffer_id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = buffer_groups_.find(buffer_group);
+    if (it == buffer_groups_.end() || buffer_id < 0) {
+      return nullptr;
+    }
+    return it->second.base + it->second.size * buffer_id;
+  }
+
+  // 归还内核选择的缓存区。
+  bool recycle_buffer(std::uint16_t buffer_group, int buffer_id) {
+    std::uint8_t* data = get_buffer(buffer_group, buffer_id);
+    if (data == nullptr) {
+      return false;
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::size_t size = buffer_groups_[buffer_group].size;
+    lock.unlock();
+    return provide(buffer_group, data, size, 1, static_cast<std::uint16_t>(buffer_id));
+  }
+
+  // 立即提交已经准备的操作。
+  int submit() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return ring_.submit(0);
+  }
+
+private:
+  static const std::uint64_t handler_tag = 1;
+
+  struct buffer_group_info {
+    std::uint8_t* base;
+    std::size_t size;
+  };
+
+  bool provide(
+      std::uint16_t buffer_group,
+      std::uint8_t* base,
+      std::size_t size,
+      std::uint16_t count,
+      std::uint16_t first_id) {
+    return prepare(nullptr, nullptr, io_type::unknown, [&](io_uring_sqe* sqe) {
+      sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+      sqe->fd = count;
+      sqe->addr = reinterpret_cast<std::uint64_t>(base);
+      sqe->len = static_cast<unsigned>(size);
+      sqe->off = first_id;
+      sqe->buf_group = buffer_group;
+    });
+  }
+
+  static void set_rw(
+      io_uring_sqe* sqe,
+      std::uint8_t opcode,
+      int fd,
+      const void* data,
+      unsigned length,
+      std::uint64_t offset,
+      std::uint8_t sqe_flags) {
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->flags = sqe_flags;
+    sqe->addr = reinterpret_cast<std::uint64_t>(data);
+    sqe->len = length;
+    sqe->off = offset;
+  }
+
+  template<typename Function>
+  bool prepare(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      io_type type,
+      Function fill) {
+    if (context != nullptr) {
+      context->completion_handler = handler;
+      context->type = type;
+      context->is_pending = true;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (sqe == nullptr) {
+      // 提交队列满了，先提交再重试。
+      ring_.submit(0);
+      sqe = ring_.get_sqe();
+      if (sqe == nullptr) {
+        if (context != nullptr) {
+          context->is_pending = false;
+        }
+        return false;
+      }
+    }
+    fill(sqe);
+    if (context != nullptr || handler == nullptr) {
+      sqe->user_data = reinterpret_cast<std::uint64_t>(context);
+    } else {
+      // 没有上下文时直接携带 handler，以最低位区分。
+      sqe->user_data = reinterpret_cast<std::uint64_t>(handler) | handler_tag;
+    }
+
+    // 不在 run_loop 线程中时立即提交，run_loop 可能正阻塞在等待中。
+    if (!in_loop_.load(std::memory_order_acquire) ||
+        std::this_thread::get_id() != loop_thread_) {
+      ring_.submit(0);
+    }
+    return true;
+  }
+
+  void completed(const io_uring_cqe& cqe) {
+    if (cqe.user_data & handler_tag) {
+      io_completion_handler* handler =
+          reinterpret_cast<io_completion_handler*>(cqe.user_data & ~handler_tag);
+      invoke(handler, nullptr, cqe.res);
+      return;
+    }
+
+    overlapped_io_context* context = reinterpret_cast<overlapped_io_context*>(cqe.user_data);
+    if (context == nullptr) {
+      if (cqe.res < 0 && cqe.res != -ECANCELED) {
+        CALF_LOG_RATE(warn, 10) << "io_uring internal operation failed with error " << -cqe.res;
+      }
+      return;
+    }
+
+    context->result = cqe.res;
+    context->flags = cqe.flags;
+    context->is_pending = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    context->buffer_id = (cqe.flags & IORING_CQE_F_BUFFER)
+        ? static_cast<int>(cqe.flags >> IORING_CQE_BUFFER_SHIFT)
+        : -1;
+    context->bytes_transferred = cqe.res > 0 ? static_cast<std::size_t>(cqe.res) : 0;
+
+    io_completion_handler* handler = context->completion_handler;
+    if (handler == nullptr) {
+      return;
+    }
+    invoke(handler, context, cqe.res);
+  }
+
+  void invoke(io_completion_handler* handler, overlapped_io_context* context, int res) {
+    bool watched = heartbeat_.is_watched();
+    if (watched) {
+      heartbeat_.begin(typeid(*handler).name());
+    }
+    if (res >= 0) {
+      handler->io_completed(context);
+    } else {
+      handler->io_broken(context, -res);
+    }
+    if (watched) {
+      heartbeat_.end();
+    }
+  }
+
+private:
+  io_completion_ring ring_;
+  std::mutex mutex_;
+  std::atomic_bool quit_flag_;
+  std::thread::id loop_thread_;
+  std::atomic_bool in_loop_;
+  std::map<std::uint16_t, buffer_group_info> buffer_groups_;
+  loop_heartbeat heartbeat_;
+};
+
+// 基于 io_uring 的异步文件通道，接口与 file_channel 相同。
+// 写入和 fdatasync 都通过 io_completion_service 提交，不占用额外的线程。
+// 同一时刻只有一个写入或落盘操作在进行，其间的写入和等待者合并到下一批，实现组提交。
+// 回调在 io_completion_service 的 run_loop 线程中执行。
+class completion_file_channel
+  : protected io_completion_handler {
+public:
+  using file_handler = std::function<void(completion_file_channel& channel)>;
+  using sync_handler = file_write_queue::sync_handler;
+
+public:
+  completion_file_channel(
+      const std::string& file_path,
+      io_completion_service& io_service,
+      const file_handler& handler = file_handler(),
+      const file_channel_options& options = file_channel_options())
+    : io_service_(io_service),
+      handler_(handler),
+      queue_(open(file_path, options)),
+      offset_(0),
+      written_(queue_.get_queued_bytes()),
+      durable_(queue_.get_queued_bytes()),
+      sync_target_(0),
+      type_(io_type::open),
+      error_(0) {}
+
+  completion_file_channel(const completion_file_channel&) = delete;
+  completion_file_channel& operator=(const completion_file_channel&) = delete;
+
+  ~completion_file_channel() {
+    close();
+  }
+
+  bool is_valid() { return file_.is_valid(); }
+
+  std::uint64_t write(const std::uint8_t* data, std::size_t size) {
+    std::uint64_t end = 0;
+    if (queue_.push(data, size, &end)) {
+      next_batch();
+    }
+    return end;
+  }
+
+  std::uint64_t write(const std::string& data) {
+    return write(reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+  }
+
+  std::uint64_t write(io_buffer& buffer) {
+    std::uint64_t end = 0;
+    if (queue_.push(std::move(buffer), &end)) {
+      next_batch();
+    }
+    return end;
+  }
+
+  std::uint64_t write(const shared_buffer& buffer) {
+    std::uint64_t end = 0;
+    if (queue_.push(buffer, 0, buffer->size(), &end)) {
+      next_batch();
+    }
+    return end;
+  }
+
+  void sync(sync_handler handler) {
+    if (queue_.push_sync(std::move(handler))) {
+      next_batch();
+    }
+  }
+
+  std::future<bool> sync() {
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = promise->get_future();
+    sync([promise](bool success) {
+      promise->set_value(success);
+    });
+    return result;
+  }
+
+  // 等待已经写入的数据处理完再关闭文件，需要 run_loop 仍在运行。
+  void close() {
+    queue_.wait_idle();
+    file_.close();
+  }
+
+  std::uint64_t get_written_bytes() const { return written_.load(std::memory_order_acquire); }
+  std::uint64_t get_durable_bytes() const { return durable_.load(std::memory_order_acquire); }
+
+  io_type get_type() const { return type_; }
+  int get_error() const { return error_; }
+
+protected:
+  void io_completed(overlapped_io_context* context) override {
+    if (context == &sync_context_) {
+      durable_.store(sync_target_, std::memory_order_release);
+      notify(true);
+      next_batch();
+      return;
+    }
+
+    offset_ += context->bytes_transferred;
+    batch_.chain.consume(context->bytes_transferred);
+    written_.store(offset_, std::memory_order_release);
+    if (context->bytes_transferred == 0 && !batch_.chain.empty()) {
+      broken(EIO);
+    } else if (!batch_.chain.empty()) {
+      // 部分写入或超过 IOV_MAX 的切片，继续写剩余部分。
+      if (submit_write()) {
+        return;
+      }
+    }
+    if (finish_batch()) {
+      return;
+    }
+    next_batch();
+  }
+
+  void io_broken(overlapped_io_context* /*context*/, int err) override {
+    broken(err);
+    notify(false);
+    next_batch();
+  }
+
+private:
+  std::uint64_t open(const std::string& file_path, const file_channel_options& options) {
+    int flags = O_WRONLY | O_CREAT | (options.truncate ? O_TRUNC : 0);
+    if (!file_.open(file_path, flags, options.mode)) {
+      CALF_LOG(error) << "file channel open failed with error " << errno;
+      return 0;
+    }
+    off_t size = file_.size();
+    return size > 0 ? static_cast<std::uint64_t>(size) : 0;
+  }
+
+  // 取下一批并发起操作，没有可以发起的操作时处理到队列为空。
+  void next_batch() {
+    while (queue_.take(batch_)) {
+      offset_ = batch_.offset;
+      if (error_ == 0 && !batch_.chain.empty() && submit_write()) {
+        return;
+      }
+      if (finish_batch()) {
+        return;
+      }
+    }
+  }
+
+  bool submit_write() {
+    iov_.clear();
+    for (auto& slice : batch_.chain) {
+      iovec item;
+      item.iov_base = const_cast<std::uint8_t*>(slice.data());
+      item.iov_len = slice.size;
+      iov_.push_back(item);
+      if (iov_.size() == IOV_MAX) {
+        break;
+      }
+    }
+    if (!io_service_.writev(this, &write_context_, file_.get_fd(),
+        iov_.data(), static_cast<unsigned>(iov_.size()), offset_)) {
+      broken(EBUSY);
+      return false;
+    }
+    return true;
+  }
+
+  // 本批数据写完，有等待者时发起落盘，返回是否发起了操作。
+  bool finish_batch() {
+    if (batch_.waiters.empty()) {
+      return false;
+    }
+    std::uint64_t written = written_.load(std::memory_order_relaxed);
+    if (error_ != 0 || durable_.load(std::memory_order_relaxed) >= written) {
+      notify(error_ == 0);
+      return false;
+    }
+    sync_target_ = written;
+    if (!io_service_.fsync(this, &sync_context_, file_.get_fd(), true)) {
+      broken(EBUSY);
+      notify(false);
+      return false;
+    }
+    return true;
+  }
+
+  void notify(bool success) {
+    for (auto& waiter : batch_.waiters) {
+      waiter(success);
+    }
+    batch_.waiters.clear();
+    batch_.chain.clear();
+  }
+
+  void broken(int err) {
+    if (error_ != 0) {
+      return;
+    }
+    CALF_LOG(error) << "file channel write failed with error " << err;
+    error_ = err;
+    type_ = io_type::broken;
+    if (handler_) {
+      handler_(*this);
+    }
+  }
+
+private:
+  io_completion_service& io_service_;
+  file_handler handler_;
+  file file_;
+  file_write_queue queue_;
+  file_write_queue::batch batch_;
+  std::vector<iovec> iov_;
+  overlapped_io_context write_context_;
+  overlapped_io_context sync_context_;
+  std::uint64_t offset_;
+  std::atomic<std::uint64_t> written_;
+  std::atomic<std::uint64_t> durable_;
+  std::uint64_t sync_target_;
+  io_type type_;
+  int error_;
+};
+
+} // namespace linux
+} // namespace platform
+} // namespace calf
+
+#endif // CALF_PLATFORM_LINUX_IO_COMPLETION_HPP_
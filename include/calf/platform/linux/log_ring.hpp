@@ -0,0 +1,372 @@
+// 崩溃可恢复的内存映射日志环。
+//
+// 日志记录直接写入 MAP_SHARED 映射的文件，文件被当作环形缓存使用。
+// 写入只有内存拷贝，没有系统调用；进程崩溃后数据仍在页缓存中，由内核写回文件，
+// 之后可以用 log_ring_reader 按写入顺序取出最后的记录。
+//
+// 文件布局：
+//   [0, 4096)             log_ring_header
+//   [4096, 4096 + 容量)    数据区，按 8 字节对齐的帧顺序写入，写到尾部后回绕
+//
+// 帧布局：magic(4) size(4) position(8) checksum(4) reserved(4) payload(size)
+// position 是帧在环中的绝对位置，读取时用它排除上一圈残留的旧帧；
+// magic 最后写入，写入中途崩溃的帧校验不通过，读取时跳过。
+//
+#ifndef CALF_PLATFORM_LINUX_LOG_RING_HPP_
+#define CALF_PLATFORM_LINUX_LOG_RING_HPP_
+
+#include "posix.hpp"
+#include "file_io.hpp"
+#include "../../logging.hpp"
+#include "../../log_encoding.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace calf {
+namespace platform {
+namespace linux {
+namespace logging {
+
+using calf::logging::log_target;
+using calf::logging::log_record;
+using calf::logging::log_format;
+using calf::logging::log_string;
+
+struct log_ring_header {
+  static const std::size_t size = 4096;
+  static const std::uint32_t current_version = 1;
+
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t header_size;
+  std::uint64_t capacity;
+  // 已分配的总字节数，只增不减，对容量取模即为写入位置。
+  alignas(64) std::atomic<std::uint64_t> head;
+};
+
+static_assert(sizeof(log_ring_header) <= log_ring_header::size, "log ring header too large");
+
+struct log_ring_frame {
+  static const std::uint32_t frame_magic = 0x474e5243;  // "CRNG"
+  static const std::size_t alignment = 8;
+
+  std::uint32_t magic;
+  std::uint32_t size;
+  std::uint64_t position;
+  std::uint32_t checksum;
+  std::uint32_t reserved;
+
+  static std::uint64_t frame_size(std::uint64_t payload_size) {
+    return (sizeof(log_ring_frame) + payload_size + alignment - 1) & ~(alignment - 1);
+  }
+
+  // FNV-1a，覆盖长度、位置和内容。
+  static std::uint32_t compute_checksum(
+      std::uint32_t size,
+      std::uint64_t position,
+      const std::uint8_t* data,
+      std::size_t length,
+      std::uint32_t hash = 2166136261u) {
+    hash = mix(hash, &size, sizeof(size));
+    hash = mix(hash, &position, sizeof(position));
+    return mix(hash, data, length);
+  }
+
+  static std::uint32_t mix(std::uint32_t hash, const void* data, std::size_t length) {
+    const std::uint8_t* p = static_cast<const std::uint8_t*>(data);
+    for (std::size_t i = 0; i < length; ++i) {
+      hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+  }
+};
+
+static_assert(sizeof(log_ring_frame) == 24, "unexpected log ring frame layout");
+
+static const char log_ring_magic[8] = { 'C', 'A', 'L', 'F', 'R', 'I', 'N', 'G' };
+
+struct log_ring_options {
+  // 数据区容量，向上取整为 2 的幂。
+  std::size_t capacity = 16 * 1024 * 1024;
+  // 结构化记录的编码格式。
+  log_format format = log_format::text;
+};
+
+// 内存映射日志环输出目标，可以被多个线程同时写入。
+// 已有的环文件容量一致时接着写入，保留上次运行的记录。
+class log_ring_target
+  : public log_target {
+public:
+  log_ring_target(
+      const std::string& file_name,
+      const log_ring_options& options = log_ring_options())
+    : options_(options),
+      header_(nullptr),
+      data_(nullptr),
+      capacity_(round_up(options.capacity)),
+      mask_(capacity_ - 1),
+      mapped_size_(0) {
+    open(file_name);
+  }
+
+  ~log_ring_target() {
+    if (header_ != nullptr) {
+      ::munmap(header_, mapped_size_);
+    }
+  }
+
+  log_ring_target(const log_ring_target&) = delete;
+  log_ring_target& operator=(const log_ring_target&) = delete;
+
+  bool is_open() { return header_ != nullptr; }
+
+  void output(const log_string& data) override {
+    std::string& buffer = local_buffer();
+    buffer.clear();
+    calf::logging::append_utf8(buffer, data.data(), data.size());
+    put(buffer.data(), buffer.size());
+  }
+
+  void write(log_record&& record) override {
+    std::string& buffer = local_buffer();
+    buffer.clear();
+    calf::logging::encode(record, options_.format, buffer);
+    put(buffer.data(), buffer.size());
+  }
+
+  // 写回磁盘，用于防范掉电。进程崩溃时不需要调用。
+  void sync() override {
+    if (header_ != nullptr) {
+      ::msync(header_, mapped_size_, MS_SYNC);
+    }
+  }
+
+  // 写入一条已经编码的记录，超过容量的记录被截断。
+  void put(const void* data, std::size_t size) {
+    if (header_ == nullptr) {
+      return;
+    }
+    std::size_t max_payload = capacity_ / 2 - sizeof(log_ring_frame);
+    if (size > max_payload) {
+      size = max_payload;
+    }
+
+    std::uint64_t length = log_ring_frame::frame_size(size);
+    std::uint64_t position = header_->head.fetch_add(length, std::memory_order_relaxed);
+    std::uint32_t* magic = reinterpret_cast<std::uint32_t*>(data_ + (position & mask_));
+    __atomic_store_n(magic, 0u, __ATOMIC_RELAXED);
+
+    log_ring_frame frame;
+    frame.magic = 0;
+    frame.size = static_cast<std::uint32_t>(size);
+    frame.position = position;
+    frame.checksum = log_ring_frame::compute_checksum(
+        frame.size, position, static_cast<const std::uint8_t*>(data), size);
+    frame.reserved = 0;
+    copy_in(position + sizeof(frame.magic),
+        reinterpret_cast<const std::uint8_t*>(&frame) + sizeof(frame.magic),
+        sizeof(frame) - sizeof(frame.magic));
+    copy_in(position + sizeof(frame), data, size);
+    __atomic_store_n(magic, log_ring_frame::frame_magic, __ATOMIC_RELEASE);
+  }
+
+  std::size_t capacity() { return capacity_; }
+
+private:
+  static std::size_t round_up(std::size_t n) {
+    std::size_t size = 4096;
+    while (size < n) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  static std::string& local_buffer() {
+    thread_local std::string buffer;
+    return buffer;
+  }
+
+  void open(const std::string& file_name) {
+    file ring_file;
+    if (!ring_file.open(file_name, O_RDWR | O_CREAT)) {
+      return;
+    }
+
+    mapped_size_ = log_ring_header::size + capacity_;
+    bool reuse = static_cast<std::size_t>(ring_file.size()) == mapped_size_;
+    if (!reuse && ::ftruncate(ring_file.get_fd(), static_cast<off_t>(mapped_size_)) != 0) {
+      return;
+    }
+
+    void* address = ::mmap(nullptr, mapped_size_,
+        PROT_READ | PROT_WRITE, MAP_SHARED, ring_file.get_fd(), 0);
+    if (address == MAP_FAILED) {
+      return;
+    }
+    header_ = static_cast<log_ring_header*>(address);
+    data_ = static_cast<std::uint8_t*>(address) + log_ring_header::size;
+
+    if (reuse &&
+        std::memcmp(header_->magic, log_ring_magic, sizeof(log_ring_magic)) == 0 &&
+        header_->version == log_ring_header::current_version &&
+        header_->capacity == capacity_) {
+      return;
+    }
+
+    std::memset(static_cast<void*>(header_), 0, log_ring_header::size);
+    header_->version = log_ring_header::current_version;
+    header_->header_size = log_ring_header::size;
+    header_->capacity = capacity_;
+    header_->head.store(0, std::memory_order_relaxed);
+    std::memcpy(header_->magic, log_ring_magic, sizeof(log_ring_magic));
+  }
+
+  void copy_in(std::uint64_t position, const void* data, std::size_t size) {
+    std::size_t offset = static_cast<std::size_t>(position & mask_);
+    std::size_t first = capacity_ - offset;
+    if (first >= size) {
+      std::memcpy(data_ + offset, data, size);
+    } else {
+      std::memcpy(data_ + offset, data, first);
+      std::memcpy(data_, static_cast<const std::uint8_t*>(data) + first, size - first);
+    }
+  }
+
+private:
+  log_ring_options options_;
+  log_ring_header* header_;
+  std::uint8_t* data_;
+  std::size_t capacity_;
+  std::size_t mask_;
+  std::size_t mapped_size_;
+};
+
+// 从环文件中恢复记录，按写入顺序返回仍然完整的部分。
+// 读取的是文件副本，不需要与写入进程同步。
+class log_ring_reader {
+public:
+  log_ring_reader() : capacity_(0), head_(0) {}
+
+  bool open(const std::string& file_name) {
+    file ring_file;
+    if (!ring_file.open(file_name, O_RDONLY)) {
+      return false;
+    }
+    off_t file_size = ring_file.size();
+    if (file_size < static_cast<off_t>(log_ring_header::size)) {
+      return false;
+    }
+
+    std::vector<std::uint8_t> header(log_ring_header::size);
+    if (!read_all(ring_file, header.data(), header.size())) {
+      return false;
+    }
+    const log_ring_header* ring_header = reinterpret_cast<const log_ring_header*>(header.data());
+    if (std::memcmp(ring_header->magic, log_ring_magic, sizeof(log_ring_magic)) != 0 ||
+        ring_header->version != log_ring_header::current_version ||
+        ring_header->header_size != log_ring_header::size) {
+      return false;
+    }
+    capacity_ = ring_header->capacity;
+    head_ = ring_header->head.load(std::memory_order_relaxed);
+    if (capacity_ == 0 || (capacity_ & (capacity_ - 1)) != 0 ||
+        static_cast<std::uint64_t>(file_size) < log_ring_header::size + capacity_) {
+      return false;
+    }
+
+    data_.resize(capacity_);
+    return read_all(ring_file, data_.data(), data_.size());
+  }
+
+  // 按写入顺序回调 f(const std::uint8_t* data, std::size_t size)。
+  // 最旧的一条记录可能被新数据覆盖了一部分，遇到无效帧时按 8 字节对齐向后重新同步。
+  template<typename Function>
+  std::size_t for_each(Function f) {
+    std::uint64_t position = head_ > capacity_ ? head_ - capacity_ : 0;
+    std::size_t count = 0;
+    std::vector<std::uint8_t> payload;
+    while (position + sizeof(log_ring_frame) <= head_) {
+      log_ring_frame frame;
+      copy_out(position, &frame, sizeof(frame));
+      std::uint64_t length = log_ring_frame::frame_size(frame.size);
+      if (frame.magic != log_ring_frame::frame_magic ||
+          frame.position != position ||
+          frame.size > capacity_ / 2 ||
+          position + length > head_) {
+        position += log_ring_frame::alignment;
+        continue;
+      }
+
+      payload.resize(frame.size);
+      copy_out(position + sizeof(frame), payload.data(), payload.size());
+      if (log_ring_frame::compute_checksum(frame.size, position, payload.data(), payload.size()) !=
+          frame.checksum) {
+        position += log_ring_frame::alignment;
+        continue;
+      }
+
+      f(static_cast<const std::uint8_t*>(payload.data()), payload.size());
+      ++count;
+      position += length;
+    }
+    return count;
+  }
+
+  // 取最后 n 条记录，n 为 0 时取全部。
+  std::vector<std::string> tail(std::size_t n = 0) {
+    std::vector<std::string> records;
+    for_each([&records](const std::uint8_t* data, std::size_t size) {
+      records.emplace_back(reinterpret_cast<const char*>(data), size);
+    });
+    if (n != 0 && records.size() > n) {
+      records.erase(records.begin(), records.end() - n);
+    }
+    return records;
+  }
+
+  std::uint64_t capacity() { return capacity_; }
+  std::uint64_t head() { return head_; }
+
+private:
+  static bool read_all(file& ring_file, std::uint8_t* data, std::size_t size) {
+    while (size > 0) {
+      ssize_t ret = ring_file.read(data, size);
+      if (ret <= 0) {
+        return false;
+      }
+      data += ret;
+      size -= static_cast<std::size_t>(ret);
+    }
+    return true;
+  }
+
+  void copy_out(std::uint64_t position, void* data, std::size_t size) {
+    std::size_t offset = static_cast<std::size_t>(position & (capacity_ - 1));
+    std::size_t first = static_cast<std::size_t>(capacity_) - offset;
+    if (first >= size) {
+      std::memcpy(data, data_.data() + offset, size);
+    } else {
+      std::memcpy(data, data_.data() + offset, first);
+      std::memcpy(static_cast<std::uint8_t*>(data) + first, data_.data(), size - first);
+    }
+  }
+
+private:
+  std::uint64_t capacity_;
+  std::uint64_t head_;
+  std::vector<std::uint8_t> data_;
+};
+
+} // namespace logging
+} // namespace linux
+} // namespace platform
+} // namespace calf
+
+#endif // CALF_PLATFORM_LINUX_LOG_RING_HPP_
@@ -5,54 +5,1067 @@
 #include "file_io.hpp"
 #include "debugging.hpp"
 
+#include <atomic>
 #include <cstdint>
 #include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <sys/socket.h> // ::socket()
 #include <netinet/in.h> // struct sockaddr_id
+#include <netinet/tcp.h> // TCP_NODELAY
 #include <arpa/inet.h> // ::inet_pton()
+#include <sys/sendfile.h> // ::sendfile()
 
 namespace calf {
 namespace platform {
 namespace linux {
 
+// 非阻塞 TCP Socket。
 class socket
-  : public file_descriptor,
-    public io_event_handler {
+  : public file_descriptor {
 public:
   socket() {
     create();
   }
 
-  bool bind(std::string ip, uint16_t port) {
-    sockaddr_in local_addr;
-    memset(&local_addr, 0, sizeof(local_addr));
-    local_addr.sin_family = AF_INET;
-    ::inet_pton(AF_INET, "127.0.0.1", &local_addr.sin_addr);
-    local_addr.sin_port = ::htons(3000);
+  explicit socket(int fd) : file_descriptor(fd) {}
+
+  socket(const socket& other) = delete;
+
+  socket(socket&& other) {
+    fd_ = other.fd_;
+    other.fd_ = -1;
+  }
 
+  bool bind(const std::string& ip, std::uint16_t port) {
+    sockaddr_in local_addr;
+    if (!make_sockaddr(ip, port, local_addr)) {
+      return false;
+    }
     int ret = ::bind(fd_, reinterpret_cast<sockaddr*>(&local_addr), sizeof(local_addr));
     return ret != -1;
   }
 
-  void listen() {
-    ::listen(fd_, 5);
+  bool listen(int backlog = SOMAXCONN) {
+    return ::listen(fd_, backlog) != -1;
   }
 
-  // Override class io_event_handler method.
-  virtual void io_event_arrived(io_event_context* context) override {
+  // 返回新连接的描述符，没有连接时返回 -1 且 errno 为 EAGAIN。
+  int accept(sockaddr_in* remote_addr = nullptr) {
+    sockaddr_in addr;
+    socklen_t length = sizeof(addr);
+    int fd = -1;
+    do {
+      fd = ::accept4(fd_, reinterpret_cast<sockaddr*>(&addr), &length,
+          SOCK_NONBLOCK | SOCK_CLOEXEC);
+    } while (fd < 0 && errno == EINTR);
+    if (fd >= 0 && remote_addr != nullptr) {
+      *remote_addr = addr;
+    }
+    return fd;
+  }
+
+  // 非阻塞连接，返回 false 且 errno 为 EINPROGRESS 时等待可写通知。
+  bool connect(const std::string& ip, std::uint16_t port) {
+    sockaddr_in remote_addr;
+    if (!make_sockaddr(ip, port, remote_addr)) {
+      return false;
+    }
+    int ret = 0;
+    do {
+      ret = ::connect(fd_, reinterpret_cast<sockaddr*>(&remote_addr), sizeof(remote_addr));
+    } while (ret < 0 && errno == EINTR);
+    return ret == 0;
+  }
+
+  bool set_reuse_address(bool enable) {
+    return set_option(SOL_SOCKET, SO_REUSEADDR, enable ? 1 : 0);
+  }
+
+  bool set_reuse_port(bool enable) {
+    return set_option(SOL_SOCKET, SO_REUSEPORT, enable ? 1 : 0);
+  }
+
+  bool set_no_delay(bool enable) {
+    return set_option(IPPROTO_TCP, TCP_NODELAY, enable ? 1 : 0);
+  }
+
+  bool set_option(int level, int name, int value) {
+    return ::setsockopt(fd_, level, name, &value, sizeof(value)) == 0;
+  }
+
+  int get_error() {
+    int err = 0;
+    socklen_t length = sizeof(err);
+    if (::getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &length) != 0) {
+      return errno;
+    }
+    return err;
+  }
+
+  static bool make_sockaddr(const std::string& ip, std::uint16_t port, sockaddr_in& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    return ::inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) == 1;
+  }
 
+  static std::string get_sockaddr_addr(const sockaddr_in& addr) {
+    char address[INET_ADDRSTRLEN] = { 0 };
+    ::inet_ntop(AF_INET, &addr.sin_addr, address, sizeof(address));
+    return std::string(address);
   }
-  
+
+  static std::uint16_t get_sockaddr_port(const sockaddr_in& addr) {
+    return ntohs(addr.sin_port);
+  }
+
 protected:
   bool create() {
-    fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    return is_valid();
+  }
+};
+
+class socket_channel;
+
+// 管理连接的生命周期，连接关闭后由所有者在反应器线程中释放。
+class socket_channel_owner {
+public:
+  virtual void release(socket_channel* channel) = 0;
+};
+
+// Socket 通信通道，接口与 Windows 版本一致。
+// 以边沿触发方式同时关注读写，注册后不再修改关注的事件。
+// 所有事件都在所属反应器线程中处理，handler 在类型为 broken 时被调用后，通道在反应器的下一轮任务中被释放；
+// 没有所有者的通道可以在 broken 回调中由使用者析构。
+// send_file 发送的文件每发送完一个，handler 以 write 类型被调用一次。
+class socket_channel
+  : public io_event_handler {
+public:
+  using socket_handler = std::function<void(socket_channel&)>;
+
+  static const std::size_t default_buffer_size = 16 * 1024;
+  // 接收缓存区的上限，发送使用 buffer_chain，没有上限。
+  static const std::size_t max_buffer_size = 128 * 1024 * 1024;
+  static const std::size_t max_iov_count = 64;
+  // 单次 sendfile 的上限。
+  static const std::size_t max_sendfile_size = 0x7ffff000;
+
+public:
+  socket_channel(io_multiplexing_service& io_service, const socket_handler& handler)
+    : io_service_(io_service),
+      socket_(-1),
+      handler_(handler),
+      owner_(nullptr),
+      connected_flag_(false),
+      closed_flag_(false),
+      queued_bytes_(0),
+      sent_bytes_(0),
+      completed_files_(0),
+      recv_stalled_(false) {
+    std::memset(&remote_addr_, 0, sizeof(remote_addr_));
+    context_.event_handler = this;
+  }
+
+  ~socket_channel() {
+    if (context_.fd >= 0) {
+      io_service_.deregister_fd(&context_);
+    }
+  }
+
+  // 主动连接。
+  bool connect(const std::string& ip, std::uint16_t port) {
+    socket_.reset(socket().release_fd());
+    socket_.set_no_delay(true);
+    socket::make_sockaddr(ip, port, remote_addr_);
+    bool connected = socket_.connect(ip, port);
+    if (!connected && errno != EINPROGRESS) {
+      return false;
+    }
+    context_.type = io_type::open;
+    return io_service_.register_fd(socket_, &context_, event_mask);
+  }
+
+  // 接管已经建立的连接。
+  bool attach(int fd, const sockaddr_in& remote_addr, socket_channel_owner* owner = nullptr) {
+    socket_.reset(fd);
+    socket_.set_no_delay(true);
+    remote_addr_ = remote_addr;
+    owner_ = owner;
+    connected_flag_.store(true, std::memory_order_release);
+    context_.type = io_type::open;
+    return io_service_.register_fd(socket_, &context_, event_mask);
+  }
+
+  void send_buffer(const std::uint8_t* data, std::size_t size) {
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    send_buffer_.append(data, size);
+    queued_bytes_ += size;
+    flush_and_notify(lock);
+  }
+
+  void send_buffer(const std::string& data) {
+    send_buffer(reinterpret_cast<const std::uint8_t*>(data.data()), data.size());
+  }
+
+  // 直接使用 io_buffer 可以利用移动语义接管缓存区，不拷贝内容，性能较好。
+  void send_buffer(io_buffer& buffer) {
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    queued_bytes_ += buffer.size();
+    send_buffer_.append(std::move(buffer));
+    flush_and_notify(lock);
+  }
+
+  // 按引用发送共享的缓存区，同一份数据可以发给多个连接，发送完之前不能修改。
+  void send_buffer(const shared_buffer& buffer, std::size_t offset, std::size_t size) {
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    send_buffer_.append(buffer, offset, size);
+    queued_bytes_ += size;
+    flush_and_notify(lock);
+  }
+
+  void send_buffer(const shared_buffer& buffer) {
+    send_buffer(buffer, 0, buffer->size());
+  }
+
+  // 用 sendfile 把文件 fd 从 offset 开始的 length 字节直接发送到连接，数据不经过用户态。
+  // 与 send_buffer 的数据按调用顺序发送，只在反应器线程中推进，可写通知驱动剩余部分。
+  // 发送完成前 fd 必须保持打开，完成后 handler 以 write 类型被调用。
+  void send_file(int fd, std::uint64_t offset, std::uint64_t length) {
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    send_file_item item;
+    item.fd = fd;
+    item.offset = offset;
+    item.remaining = length;
+    item.position = queued_bytes_;
+    if (length == 0) {
+      ++completed_files_;
+    } else {
+      send_files_.push_back(item);
+      queued_bytes_ += length;
+    }
+    flush_and_notify(lock);
+  }
+
+  // 尚未写出的字节数，包括未发送的文件部分。
+  std::uint64_t get_pending_bytes() {
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    return queued_bytes_ - sent_bytes_;
+  }
+
+  io_buffer recv_buffer() {
+    io_buffer buffer;
+    recv_buffer(buffer);
+    return buffer;
+  }
+
+  // 接收缓存曾经达到上限时，取走后重新开启可读通知，继续读取套接字中剩余的数据。
+  void recv_buffer(io_buffer& buffer) {
+    std::unique_lock<std::mutex> lock(recv_mutex_);
+    buffer.swap(recv_buffer_);
+    bool stalled = recv_stalled_;
+    recv_stalled_ = false;
+    lock.unlock();
+    if (stalled) {
+      std::unique_lock<std::mutex> send_lock(send_mutex_);
+      if (!closed_flag_) {
+        io_service_.rearm_fd(&context_);
+      }
+    }
+  }
+
+  io_type get_type() {
+    return context_.type;
+  }
+
+  std::string get_remote_addr() {
+    return socket::get_sockaddr_addr(remote_addr_);
+  }
+
+  std::uint16_t get_remote_port() {
+    return socket::get_sockaddr_port(remote_addr_);
+  }
+
+  io_multiplexing_service& get_service() { return io_service_; }
+
+  // 在所属反应器线程中调用。
+  void close() {
+    closed(0);
+  }
+
+  // 从反应器注销并交出连接的描述符，之后通道不再收发数据，也不再调用 handler。
+  // 在所属反应器线程中调用，例如在 open 回调中把连接交给 socket_relay；
+  // 有所有者时通道稍后由所有者释放。
+  int detach() {
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    if (closed_flag_.load(std::memory_order_relaxed)) {
+      return -1;
+    }
+    closed_flag_.store(true, std::memory_order_release);
+    io_service_.deregister_fd(&context_);
+    int fd = socket_.release_fd();
+    lock.unlock();
+    release_later();
+    return fd;
+  }
+
+private:
+  static const std::uint32_t event_mask = io_event::read | io_event::write | io_event::edge_triggered;
+
+  struct send_file_item {
+    int fd;
+    std::uint64_t offset;
+    std::uint64_t remaining;
+    std::uint64_t position;
+  };
+
+  // Override class io_event_handler method.
+  void io_event_arrived(io_event_context* context) override {
+    if (!connected_flag_.load(std::memory_order_acquire)) {
+      if (!context->is_writable() && !context->is_hangup()) {
+        return;
+      }
+      int err = socket_.get_error();
+      if (err != 0) {
+        closed(err);
+        return;
+      }
+      connected_flag_.store(true, std::memory_order_release);
+      context_.type = io_type::open;
+      if (handler_) {
+        handler_(*this);
+      }
+      if (closed_flag_) {
+        return;
+      }
+    }
+
+    if (context->is_writable()) {
+      std::unique_lock<std::mutex> lock(send_mutex_);
+      if (!flush()) {
+        lock.unlock();
+        closed(errno);
+        return;
+      }
+      lock.unlock();
+      if (!notify_sent()) {
+        return;
+      }
+    }
+
+    if (context->is_readable()) {
+      receive();
+    }
+  }
+
+  void io_broken(io_event_context* /*context*/, int err) override {
+    closed(err);
+  }
+
+  // 读到 EAGAIN 或用完反应器的读取预算为止，然后通知一次。
+  // 用完预算时放入反应器的就绪列表，下一轮继续读取。
+  void receive() {
+    bool eof = false;
+    bool exhausted = false;
+    int err = 0;
+    std::size_t total = 0;
+    std::size_t budget = io_service_.get_read_budget();
+    std::unique_lock<std::mutex> lock(recv_mutex_);
+    for (;;) {
+      std::size_t offset = recv_buffer_.size();
+      if (offset + default_buffer_size > max_buffer_size) {
+        // 边沿触发不会再次通知，等消费者取走数据后由 recv_buffer 重新开启。
+        recv_stalled_ = true;
+        break;
+      }
+      if (budget != 0 && total >= budget) {
+        exhausted = true;
+        break;
+      }
+      recv_buffer_.resize(offset + default_buffer_size);
+      ssize_t ret = ::recv(socket_.get_fd(), recv_buffer_.data() + offset, default_buffer_size, 0);
+      if (ret > 0) {
+        recv_buffer_.resize(offset + ret);
+        total += ret;
+        continue;
+      }
+
+      recv_buffer_.resize(offset);
+      if (ret == 0) {
+        eof = true;
+      } else if (errno == EINTR) {
+        continue;
+      } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        err = errno;
+      }
+      break;
+    }
+    lock.unlock();
+
+    // 在 handler 之前放入就绪列表，handler 中关闭通道时注销会把它移出列表。
+    if (exhausted) {
+      io_service_.defer(&context_);
+    }
+    if (total > 0) {
+      context_.type = io_type::read;
+      if (handler_) {
+        handler_(*this);
+      }
+    }
+    if ((eof || err != 0) && !closed_flag_) {
+      if (err != 0) {
+        // 对端异常时可能频繁触发，限制输出频率。
+        CALF_LOG_RATE(warn, 10) << "socket channel receive broken: " << err;
+      }
+      closed(err);
+    }
+  }
+
+  // 调用前需持有 send_mutex_。写到 EAGAIN 为止，剩余数据等待可写通知。
+  // 每次 sendmsg 最多提交 max_iov_count 个切片，遇到文件时先发完文件之前的数据。
+  // 文件只在反应器线程中发送，其它线程写到文件边界时重新开启可写通知，交给反应器线程继续。
+  bool flush() {
+    if (!connected_flag_.load(std::memory_order_acquire) || closed_flag_) {
+      return true;
+    }
+    bool in_loop = io_service_.is_in_loop_thread();
+    for (;;) {
+      if (!send_files_.empty() && send_files_.front().position <= sent_bytes_) {
+        if (!in_loop) {
+          io_service_.rearm_fd(&context_);
+          return true;
+        }
+        int ret = send_file_front();
+        if (ret > 0) {
+          continue;
+        }
+        return ret == 0;
+      }
+
+      std::size_t limit = send_buffer_.size();
+      if (!send_files_.empty()) {
+        limit = static_cast<std::size_t>(send_files_.front().position - sent_bytes_);
+      }
+      if (limit == 0) {
+        return true;
+      }
+
+      iovec iov[max_iov_count];
+      std::size_t count = 0;
+      std::size_t total = 0;
+      for (auto& slice : send_buffer_) {
+        std::size_t size = std::min(slice.size, limit - total);
+        iov[count].iov_base = const_cast<std::uint8_t*>(slice.data());
+        iov[count].iov_len = size;
+        total += size;
+        if (++count == max_iov_count || total == limit) {
+          break;
+        }
+      }
+
+      msghdr msg;
+      std::memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = iov;
+      msg.msg_iovlen = count;
+      ssize_t ret = ::sendmsg(socket_.get_fd(), &msg, MSG_NOSIGNAL);
+      if (ret > 0) {
+        send_buffer_.consume(static_cast<std::size_t>(ret));
+        sent_bytes_ += static_cast<std::uint64_t>(ret);
+        continue;
+      }
+      if (ret < 0 && errno == EINTR) {
+        continue;
+      }
+      if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+      }
+      return false;
+    }
+  }
+
+  // 推进队首的文件，返回 1 表示可以继续，0 表示需要等待可写通知，-1 表示出错。
+  int send_file_front() {
+    send_file_item& item = send_files_.front();
+    off_t offset = static_cast<off_t>(item.offset);
+    std::size_t count = item.remaining < max_sendfile_size
+        ? static_cast<std::size_t>(item.remaining)
+        : max_sendfile_size;
+    ssize_t ret = ::sendfile(socket_.get_fd(), item.fd, &offset, count);
+    if (ret > 0) {
+      item.offset += static_cast<std::uint64_t>(ret);
+      item.remaining -= static_cast<std::uint64_t>(ret);
+      sent_bytes_ += static_cast<std::uint64_t>(ret);
+      if (item.remaining == 0) {
+        send_files_.pop_front();
+        ++completed_files_;
+      }
+      return 1;
+    }
+    if (ret == 0) {
+      // 文件比指定的长度短，其余部分不再发送，后面的数据前移。
+      CALF_LOG(warn) << "socket channel send_file reached end of file, "
+          << item.remaining << " bytes not sent";
+      std::uint64_t missing = item.remaining;
+      send_files_.pop_front();
+      for (auto& next : send_files_) {
+        next.position -= missing;
+      }
+      queued_bytes_ -= missing;
+      ++completed_files_;
+      return 1;
+    }
+    if (errno == EINTR) {
+      return 1;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return 0;
+    }
+    return -1;
+  }
+
+  // 写入后在反应器线程中通知已经发送完的文件。
+  void flush_and_notify(std::unique_lock<std::mutex>& lock) {
+    flush();
+    lock.unlock();
+    if (io_service_.is_in_loop_thread()) {
+      notify_sent();
+    }
+  }
+
+  // handler 可能在回调中关闭通道，返回通道是否仍然打开；通道延迟释放，关闭后仍可以读取状态。
+  bool notify_sent() {
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    std::size_t count = completed_files_;
+    completed_files_ = 0;
+    lock.unlock();
+
+    for (; count > 0; --count) {
+      if (closed_flag_.load(std::memory_order_acquire)) {
+        return false;
+      }
+      context_.type = io_type::write;
+      if (handler_) {
+        handler_(*this);
+      }
+    }
+    return !closed_flag_.load(std::memory_order_acquire);
+  }
+
+  // 其它线程的 flush 在 send_mutex_ 中使用描述符，持锁关闭，避免写到已经关闭或被复用的描述符。
+  // 所有者延迟到下一轮任务中释放通道，当前调用栈上 handler 返回后仍可以访问成员。
+  void closed(int /*err*/) {
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    if (closed_flag_.load(std::memory_order_relaxed)) {
+      return;
+    }
+    closed_flag_.store(true, std::memory_order_release);
+    io_service_.deregister_fd(&context_);
+    socket_.close();
+    lock.unlock();
+    // 没有所有者时 handler 可能在回调中释放通道，先安排释放，handler 之后不再访问成员。
+    release_later();
+    context_.type = io_type::broken;
+    if (handler_) {
+      handler_(*this);
+    }
+  }
+
+  void release_later() {
+    if (owner_ != nullptr) {
+      socket_channel_owner* owner = owner_;
+      io_service_.post([owner, this]() {
+        owner->release(this);
+      });
+    }
+  }
+
+private:
+  io_multiplexing_service& io_service_;
+  socket socket_;
+  io_event_context context_;
+  sockaddr_in remote_addr_;
+  socket_handler handler_;
+  socket_channel_owner* owner_;
+  std::atomic_bool connected_flag_;
+  // 反应器线程关闭，其它线程的 flush 读取。
+  std::atomic_bool closed_flag_;
+  buffer_chain send_buffer_;
+  // 待发送的文件，position 为文件在发送流中的起始位置。
+  std::deque<send_file_item> send_files_;
+  std::uint64_t queued_bytes_;
+  std::uint64_t sent_bytes_;
+  std::size_t completed_files_;
+  io_buffer recv_buffer_;
+  // 接收缓存达到上限后停止读取，由 recv_mutex_ 保护。
+  bool recv_stalled_;
+  std::mutex send_mutex_;
+  std::mutex recv_mutex_;
+};
+
+// 内核管道，用于 splice 在两个描述符之间搬运数据，数据不经过用户态。
+class kernel_pipe {
+public:
+  // 默认容量，设置失败时使用系统默认的 64KB。
+  static const int default_pipe_size = 256 * 1024;
+
+public:
+  kernel_pipe() : read_fd_(-1), write_fd_(-1), size_(0) {}
+
+  ~kernel_pipe() {
+    close();
+  }
+
+  kernel_pipe(const kernel_pipe&) = delete;
+  kernel_pipe& operator=(const kernel_pipe&) = delete;
+
+  bool create() {
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+      return false;
+    }
+    read_fd_ = fds[0];
+    write_fd_ = fds[1];
+    int size = ::fcntl(write_fd_, F_SETPIPE_SZ, default_pipe_size);
+    if (size < 0) {
+      size = ::fcntl(write_fd_, F_GETPIPE_SZ);
+    }
+    size_ = size > 0 ? static_cast<std::size_t>(size) : 0;
+    return true;
+  }
+
+  void close() {
+    if (read_fd_ >= 0) {
+      ::close(read_fd_);
+      ::close(write_fd_);
+      read_fd_ = write_fd_ = -1;
+    }
+  }
+
+  int get_read_fd() const { return read_fd_; }
+  int get_write_fd() const { return write_fd_; }
+  std::size_t get_size() const { return size_; }
+
+private:
+  int read_fd_;
+  int write_fd_;
+  std::size_t size_;
+};
+
+// 线程局部的管道池，反应器线程中的 socket_relay 从这里借用管道。
+// 只回收已经排空的管道，仍有数据的管道直接关闭。
+class pipe_pool {
+public:
+  static const std::size_t max_cached_count = 64;
+
+  static std::unique_ptr<kernel_pipe> acquire() {
+    std::vector<std::unique_ptr<kernel_pipe>>& pipes = local();
+    if (!pipes.empty()) {
+      std::unique_ptr<kernel_pipe> pipe = std::move(pipes.back());
+      pipes.pop_back();
+      return pipe;
+    }
+    std::unique_ptr<kernel_pipe> pipe(new kernel_pipe());
+    if (!pipe->create()) {
+      return nullptr;
+    }
+    return pipe;
+  }
+
+  static void release(std::unique_ptr<kernel_pipe> pipe, bool drained) {
+    std::vector<std::unique_ptr<kernel_pipe>>& pipes = local();
+    if (pipe != nullptr && drained && pipes.size() < max_cached_count) {
+      pipes.push_back(std::move(pipe));
+    }
+  }
+
+private:
+  static std::vector<std::unique_ptr<kernel_pipe>>& local() {
+    thread_local std::vector<std::unique_ptr<kernel_pipe>> pipes;
+    return pipes;
+  }
+};
+
+// 双向转发两个连接之间的数据，每个方向经过一个内核管道用 splice 搬运。
+// 以水平触发注册，目标写不动时关闭来源的可读关注、开启目标的可写关注，排空后恢复，形成背压。
+// 一个方向读到 EOF 且排空后对目标 shutdown 写端，两个方向都结束或出错时关闭两个连接，
+// 调用一次 handler，之后可以在 handler 中释放 relay。所有处理都在所属反应器线程中进行。
+class socket_relay
+  : public io_event_handler {
+public:
+  using relay_handler = std::function<void(socket_relay&)>;
+
+  // 单次 splice 的上限。
+  static const std::size_t max_splice_size = 1024 * 1024;
+
+public:
+  socket_relay(io_multiplexing_service& io_service, const relay_handler& handler)
+    : io_service_(io_service),
+      handler_(handler),
+      closed_flag_(false),
+      error_(0) {
+    for (int i = 0; i < 2; ++i) {
+      contexts_[i].event_handler = this;
+      directions_[i].source = i;
+      directions_[i].target = 1 - i;
+    }
   }
+
+  virtual ~socket_relay() {
+    close_all();
+  }
+
+  socket_relay(const socket_relay&) = delete;
+  socket_relay& operator=(const socket_relay&) = delete;
+
+  // 接管两个已经建立的连接并开始转发，在所属反应器线程中调用。
+  bool start(int first_fd, int second_fd) {
+    sockets_[0].reset(first_fd);
+    sockets_[1].reset(second_fd);
+    for (int i = 0; i < 2; ++i) {
+      directions_[i].pipe = pipe_pool::acquire();
+      if (directions_[i].pipe == nullptr) {
+        error_ = errno;
+        close_all();
+        return false;
+      }
+    }
+    for (int i = 0; i < 2; ++i) {
+      if (!io_service_.register_fd(sockets_[i], &contexts_[i], io_event::read)) {
+        error_ = errno;
+        close_all();
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // 两个方向已经转发的字节数，0 为第一个连接到第二个连接。
+  std::uint64_t get_bytes(int direction) const { return directions_[direction].bytes; }
+  // 出错时的错误码，正常结束为 0。
+  int get_error() const { return error_; }
+  bool is_closed() const { return closed_flag_; }
+
+  io_multiplexing_service& get_service() { return io_service_; }
+
+private:
+  struct direction {
+    direction()
+      : source(0), target(0), buffered(0), bytes(0), eof(false), shutdown(false) {}
+
+    int source;
+    int target;
+    std::unique_ptr<kernel_pipe> pipe;
+    // 管道中尚未写到目标的字节数。
+    std::size_t buffered;
+    std::uint64_t bytes;
+    bool eof;
+    bool shutdown;
+  };
+
+  void io_event_arrived(io_event_context* /*context*/) override {
+    for (auto& dir : directions_) {
+      if (!pump(dir)) {
+        finish(errno);
+        return;
+      }
+    }
+    if (directions_[0].shutdown && directions_[1].shutdown) {
+      finish(0);
+      return;
+    }
+    update_interest();
+  }
+
+  // 挂断说明对端数据已全部到达、发往它的方向也已关闭，此时可能因背压没有关注可读而收不到 EPOLLIN。
+  // 注销该连接避免挂断事件反复触发，剩余数据在另一个连接可写时继续读取。
+  void io_broken(io_event_context* context, int err) override {
+    if (err != 0) {
+      finish(err);
+      return;
+    }
+    io_service_.deregister_fd(context);
+    io_event_arrived(context);
+  }
+
+  // 先排空管道再从来源读，返回 false 表示出错。
+  // 每次最多从来源读取反应器读取预算的字节数，水平触发下剩余数据在下一轮继续处理。
+  // 挂断后注销的来源不再有事件，不受预算限制。
+  bool pump(direction& dir) {
+    int source_fd = sockets_[dir.source].get_fd();
+    int target_fd = sockets_[dir.target].get_fd();
+    std::size_t budget = contexts_[dir.source].fd >= 0 ? io_service_.get_read_budget() : 0;
+    std::size_t moved = 0;
+    for (;;) {
+      while (dir.buffered > 0) {
+        ssize_t ret = ::splice(dir.pipe->get_read_fd(), nullptr, target_fd, nullptr,
+            dir.buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (ret > 0) {
+          dir.buffered -= static_cast<std::size_t>(ret);
+          dir.bytes += static_cast<std::uint64_t>(ret);
+          continue;
+        }
+        if (ret < 0 && errno == EINTR) {
+          continue;
+        }
+        if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+          return true;
+        }
+        return false;
+      }
+
+      if (dir.eof) {
+        if (!dir.shutdown) {
+          ::shutdown(target_fd, SHUT_WR);
+          dir.shutdown = true;
+        }
+        return true;
+      }
+
+      if (budget != 0 && moved >= budget) {
+        return true;
+      }
+      ssize_t ret = ::splice(source_fd, nullptr, dir.pipe->get_write_fd(), nullptr,
+          max_splice_size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (ret > 0) {
+        dir.buffered += static_cast<std::size_t>(ret);
+        moved += static_cast<std::size_t>(ret);
+        continue;
+      }
+      if (ret == 0) {
+        dir.eof = true;
+        continue;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        return true;
+      }
+      return false;
+    }
+  }
+
+  // 管道有积压时只关注目标可写，否则关注来源可读。
+  void update_interest() {
+    for (int i = 0; i < 2; ++i) {
+      const direction& in = directions_[i];
+      const direction& out = directions_[1 - i];
+      std::uint32_t events = 0;
+      if (!in.eof && in.buffered == 0) {
+        events |= io_event::read;
+      }
+      if (out.buffered > 0) {
+        events |= io_event::write;
+      }
+      if (contexts_[i].fd >= 0 && events != contexts_[i].interest) {
+        io_service_.modify_fd(&contexts_[i], events);
+      }
+    }
+  }
+
+  void finish(int err) {
+    if (closed_flag_) {
+      return;
+    }
+    error_ = err;
+    close_all();
+    // 必须是最后一步，之后 this 可能已经失效。
+    if (handler_) {
+      handler_(*this);
+    }
+  }
+
+  void close_all() {
+    if (closed_flag_) {
+      return;
+    }
+    closed_flag_ = true;
+    for (int i = 0; i < 2; ++i) {
+      if (contexts_[i].fd >= 0) {
+        io_service_.deregister_fd(&contexts_[i]);
+      }
+      sockets_[i].close();
+      pipe_pool::release(std::move(directions_[i].pipe), directions_[i].buffered == 0);
+    }
+  }
+
+private:
+  io_multiplexing_service& io_service_;
+  relay_handler handler_;
+  file_descriptor sockets_[2];
+  io_event_context contexts_[2];
+  direction directions_[2];
+  bool closed_flag_;
+  int error_;
+};
+
+// 单个反应器上的监听者，接受的连接固定由该反应器处理。
+// 连接表只在反应器线程中访问，不需要加锁。
+class tcp_acceptor
+  : public io_event_handler,
+    public socket_channel_owner {
+public:
+  // 每次唤醒最多接受的连接数。
+  static const int max_accept_count = 64;
+
+public:
+  tcp_acceptor(
+      io_multiplexing_service& io_service,
+      int listen_fd,
+      const socket_channel::socket_handler& handler)
+    : io_service_(io_service),
+      listen_socket_(listen_fd),
+      handler_(handler) {
+    context_.event_handler = this;
+  }
+
+  ~tcp_acceptor() {
+    if (context_.fd >= 0) {
+      io_service_.deregister_fd(&context_);
+    }
+    // 监听描述符由 tcp_service 持有。
+    listen_socket_.release_fd();
+  }
+
+  // exclusive 为 true 时多个反应器共享同一个监听描述符，由 EPOLLEXCLUSIVE 避免惊群。
+  bool start(bool exclusive) {
+    // EPOLLEXCLUSIVE 不能与 EPOLLRDHUP 同时使用。
+    std::uint32_t events = exclusive ? (EPOLLIN | EPOLLEXCLUSIVE) : io_event::read;
+    return io_service_.register_fd(listen_socket_, &context_, events);
+  }
+
+  void release(socket_channel* channel) override {
+    channels_.erase(channel);
+  }
+
+private:
+  // 水平触发，每次最多接受 max_accept_count 个连接，剩余的连接在下一轮接受。
+  void io_event_arrived(io_event_context* /*context*/) override {
+    for (int i = 0; i < max_accept_count; ++i) {
+      sockaddr_in remote_addr;
+      int fd = listen_socket_.accept(&remote_addr);
+      if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED) {
+          CALF_LOG_RATE(warn, 10) << "accept failed with error " << errno;
+        }
+        if (errno == ECONNABORTED) {
+          continue;
+        }
+        break;
+      }
+
+      std::unique_ptr<socket_channel> channel(new socket_channel(io_service_, handler_));
+      socket_channel* raw_channel = channel.get();
+      channels_.emplace(raw_channel, std::move(channel));
+      if (!raw_channel->attach(fd, remote_addr, this)) {
+        channels_.erase(raw_channel);
+        continue;
+      }
+      if (handler_) {
+        handler_(*raw_channel);
+      }
+    }
+  }
+
+private:
+  io_multiplexing_service& io_service_;
+  socket listen_socket_;
+  io_event_context context_;
+  socket_channel::socket_handler handler_;
+  std::unordered_map<socket_channel*, std::unique_ptr<socket_channel>> channels_;
+};
+
+// 基于多反应器的 TCP 服务。
+// 优先为每个反应器创建一个 SO_REUSEPORT 监听 Socket，由内核在反应器之间分配连接；
+// 不支持时退化为共享一个监听 Socket，并以 EPOLLEXCLUSIVE 注册到所有反应器。
+class tcp_service {
+public:
+  tcp_service(const io_multiplexing_pool_options& options = io_multiplexing_pool_options())
+    : pool_(options) {}
+
+  ~tcp_service() {
+    pool_.stop();
+    pool_.join();
+  }
+
+  bool listen(
+      const std::string& ip,
+      std::uint16_t port,
+      const socket_channel::socket_handler& handler) {
+    std::vector<int> fds;
+    bool reuse_port = true;
+    for (std::size_t i = 0; i < pool_.size() && reuse_port; ++i) {
+      socket listen_socket;
+      listen_socket.set_reuse_address(true);
+      reuse_port = listen_socket.set_reuse_port(true);
+      if (!reuse_port) {
+        break;
+      }
+      if (!listen_socket.bind(ip, port) || !listen_socket.listen()) {
+        return false;
+      }
+      fds.push_back(listen_socket.get_fd());
+      listen_sockets_.emplace_back(std::move(listen_socket));
+    }
+
+    if (!reuse_port) {
+      listen_sockets_.clear();
+      fds.clear();
+      socket listen_socket;
+      listen_socket.set_reuse_address(true);
+      if (!listen_socket.bind(ip, port) || !listen_socket.listen()) {
+        return false;
+      }
+      fds.assign(pool_.size(), listen_socket.get_fd());
+      listen_sockets_.emplace_back(std::move(listen_socket));
+    }
+
+    for (std::size_t i = 0; i < pool_.size(); ++i) {
+      acceptors_.emplace_back(new tcp_acceptor(pool_.get_service(i), fds[i], handler));
+      if (!acceptors_.back()->start(!reuse_port)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // 主动发起的连接轮流分配到各个反应器，由调用者持有。
+  std::unique_ptr<socket_channel> create_socket(const socket_channel::socket_handler& handler) {
+    return std::unique_ptr<socket_channel>(new socket_channel(pool_.next_service(), handler));
+  }
+
+  void start() {
+    pool_.start();
+  }
+
+  // 启动并阻塞到 stop 被调用。
+  void run() {
+    pool_.start();
+    pool_.join();
+  }
+
+  // 可以在其它线程中调用，通知 run 返回。
+  void stop() {
+    pool_.stop();
+  }
+
+  io_multiplexing_pool& get_pool() { return pool_; }
+
+private:
+  io_multiplexing_pool pool_;
+  std::vector<socket> listen_sockets_;
+  std::vector<std::unique_ptr<tcp_acceptor>> acceptors_;
 };
 
-} // namespace linux 
+} // namespace linux
 } // namepsace platform
 } // namespace calf
 
-#endif // CALF_PLATFORM_LINUX_NETWORKING_HPP_
\ No newline at end of file
+#endif // CALF_PLATFORM_LINUX_NETWORKING_HPP_
@@ -24,6 +24,7 @@ namespace debugging {
 
 using calf::platform::windows::logging::win32_logger;
 using calf::logging::log_level;
+using calf::logging::log_char;
 
 class debug {
 public:
@@ -91,9 +92,9 @@ public:
 
 class check : public win32_logger {
 public:
-  check(const wchar_t* expr, const wchar_t* file, int line)
+  check(const wchar_t* expr, const log_char* file, int line)
     : win32_logger(log_level::error, file, line) {
-    stream_ << L"check \"" << expr << L"\" failed. ";
+    *this << L"check \"" << expr << L"\" failed. ";
   }
 
   ~check() {
@@ -102,9 +103,9 @@ public:
 
 class assert : public win32_logger {
 public:
-  assert(const wchar_t* expr, const wchar_t* file, int line)
+  assert(const wchar_t* expr, const log_char* file, int line)
     : win32_logger(log_level::error, file, line) {
-    stream_ << L"assert \"" << expr << L"\" failed. ";
+    *this << L"assert \"" << expr << L"\" failed. ";
   }
 
   ~assert() {
@@ -117,12 +118,12 @@ public:
   api_check(
       const wchar_t* expr, 
       const wchar_t* func, 
-      const wchar_t* file, 
+      const log_char* file, 
       int line)
     : check(expr, file, line) {
-    stream_ << L" call " << func << L" failed with error ";
+    *this << L" call " << func << L" failed with error ";
     DWORD err = ::GetLastError();
-    stream_ << err << L": " << debug::get_error_format(err);
+    *this << err << L": " << debug::get_error_format(err);
   }
 };
 
@@ -131,12 +132,12 @@ public:
   api_assert(
       const wchar_t* expr, 
       const wchar_t* func, 
-      const wchar_t* file, 
+      const log_char* file, 
       int line)
     : assert(expr, file, line) {
-    stream_ << L" call " << func << L" failed with error ";
+    *this << L" call " << func << L" failed with error ";
     DWORD err = ::GetLastError();
-    stream_ << err << L": " << debug::get_error_format(err);
+    *this << err << L": " << debug::get_error_format(err);
   }
 };
 
@@ -145,12 +146,22 @@ public:
 namespace logging {
 
 using calf::logging::log_target;
+using calf::logging::log_string;
   
 class log_debugger_target
   : public log_target {
 public:
-  void output(const std::wstring& data) override {
-    ::OutputDebugStringW(data.c_str());
+  void output(const log_string& data) override {
+    output_debug_string(data.c_str());
+  }
+
+private:
+  static void output_debug_string(const char* str) {
+    ::OutputDebugStringA(str);
+  }
+
+  static void output_debug_string(const wchar_t* str) {
+    ::OutputDebugStringW(str);
   }
 };
 
@@ -160,9 +171,9 @@ public:
 } // namespace platform
 } // namespace calf
 
-#define CALF_WIN32_CHECK(result) if (!(result)) calf::platform::windows::debugging::check(L#result, __FILEW__, __LINE__)
-#define CALF_WIN32_ASSERT(result) if (!(result)) calf::platform::windows::debugging::assert(L#result, __FILEW__, __LINE__)
-#define CALF_WIN32_API_CHECK(result, func) if (!(result)) calf::platform::windows::debugging::api_check(L#result, L#func, __FILEW__, __LINE__)
-#define CALF_WIN32_API_ASSERT(result, func) if (!(result)) calf::platform::windows::debugging::api_assert(L#result, L#func, __FILEW__, __LINE__)
+#define CALF_WIN32_CHECK(result) if (!(result)) calf::platform::windows::debugging::check(L#result, CALF_LOG_FILE, __LINE__)
+#define CALF_WIN32_ASSERT(result) if (!(result)) calf::platform::windows::debugging::assert(L#result, CALF_LOG_FILE, __LINE__)
+#define CALF_WIN32_API_CHECK(result, func) if (!(result)) calf::platform::windows::debugging::api_check(L#result, L#func, CALF_LOG_FILE, __LINE__)
+#define CALF_WIN32_API_ASSERT(result, func) if (!(result)) calf::platform::windows::debugging::api_assert(L#result, L#func, CALF_LOG_FILE, __LINE__)
 
 #endif // CALF_PLATFORM_WINDOWS_DEBUG_HPP_
\ No newline at end of file
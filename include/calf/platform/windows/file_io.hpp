@@ -6,6 +6,9 @@
 #include "debugging.hpp"
 #include "kernel_object.hpp"
 #include "../../worker_service.hpp"
+#include "../../time.hpp"
+#include "../../io_buffer.hpp"
+#include "../../watchdog.hpp"
 
 #include <cstdint>
 #include <mutex>
@@ -16,6 +19,7 @@
 #include <vector>
 #include <list>
 #include <thread>
+#include <typeinfo>
 
 namespace calf {
 namespace platform {
@@ -24,7 +28,8 @@ namespace windows {
 struct overlapped_io_context;
 
 using io_handler = std::function<void(overlapped_io_context&)>;
-using io_buffer = std::vector<uint8_t>;
+// 池化缓存区，扩大时不清零。
+using io_buffer = calf::pooled_buffer;
 
 enum struct io_type {
   unknown,
@@ -141,21 +146,26 @@ public:
     ULONG_PTR key = NULL;
     LPOVERLAPPED overlapped = NULL;
     DWORD err = ERROR_SUCCESS;
+    heartbeat_.attach();
     while (!quit_flag_.load(std::memory_order_relaxed)) {
       bool completed = iocp_.wait(&overlapped, &key, &bytes_transferred, &err);
+      time::loop_clock::update();
       io_completion_handler* handler = reinterpret_cast<io_completion_handler*>(key);
       overlapped_io_context* context = reinterpret_cast<overlapped_io_context*>(overlapped);
       if (context != nullptr) {
         context->bytes_transferred = bytes_transferred;
       }
       if (handler != nullptr) {
-        if (completed) {
-          handler->io_completed(context);
-        } else {
-          handler->io_broken(context, err);
-        }
+        invoke(handler, context, completed, err);
       }
     }
+    heartbeat_.detach();
+    time::loop_clock::reset();
+  }
+
+  // 交给 calf::watchdog 监视，完成回调执行过久时报告。
+  loop_heartbeat& get_heartbeat() {
+    return heartbeat_;
   }
 
   void dispatch(io_completion_handler* handler, overlapped_io_context* context) {
@@ -175,9 +185,29 @@ public:
   }
 
 protected:
+  void invoke(
+      io_completion_handler* handler,
+      overlapped_io_context* context,
+      bool completed,
+      DWORD err) {
+    bool watched = heartbeat_.is_watched();
+    if (watched) {
+      heartbeat_.begin(typeid(*handler).name());
+    }
+    if (completed) {
+      handler->io_completed(context);
+    } else {
+      handler->io_broken(context, err);
+    }
+    if (watched) {
+      heartbeat_.end();
+    }
+  }
+
   io_completion_port iocp_;
   std::mutex mtx_;
   std::atomic_bool quit_flag_;
+  loop_heartbeat heartbeat_;
 };
 
 class file
@@ -478,9 +508,11 @@ public:
     channel_ = &(service_.create_file(file_name));
   }
 
-  void output(const std::wstring& data) override {
+  void output(const calf::logging::log_string& data) override {
     if (channel_ != nullptr) {
-      channel_->write(string(data).to_string());
+      std::string record;
+      calf::logging::append_utf8(record, data.data(), data.size());
+      channel_->write(record);
     }
   }
 
@@ -12,12 +12,12 @@ using namespace calf::logging;
 
 class win32_logger : public logger {
 public:
-  win32_logger(log_level level, const wchar_t* file, int line)
+  win32_logger(log_level level, const log_char* file, int line)
     : logger(nullptr, level, file, line) {
   }
 };
 
-#define CALF_WIN32_LOG(level) calf::platform::windows::logging::logger(calf::platform::windows::logging::log_level::level, __FILEW__, __LINE__)
+#define CALF_WIN32_LOG(level) calf::platform::windows::logging::win32_logger(calf::platform::windows::logging::log_level::level, CALF_LOG_FILE, __LINE__)
 
 } // namespace logging
 } // namespace windows
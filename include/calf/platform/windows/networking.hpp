@@ -28,12 +28,12 @@ public:
   wsa_check(
       const wchar_t* expr, 
       const wchar_t* func, 
-      const wchar_t* file, 
+      const log_char* file, 
       int line)
     : check(expr, file, line) {
-    stream_ << L" call " << func << L" failed with error ";
+    *this << L" call " << func << L" failed with error ";
     DWORD err = ::WSAGetLastError();
-    stream_ << err << L": " << debug::get_error_format(err);
+    *this << err << L": " << debug::get_error_format(err);
   }
 };
 
@@ -42,19 +42,19 @@ public:
   wsa_assert(
       const wchar_t* expr, 
       const wchar_t* func, 
-      const wchar_t* file, 
+      const log_char* file, 
       int line)
     : assert(expr, file, line) {
-    stream_ << L" call " << func << L" failed with error ";
+    *this << L" call " << func << L" failed with error ";
     DWORD err = ::WSAGetLastError();
-    stream_ << err << L": " << debug::get_error_format(err);
+    *this << err << L": " << debug::get_error_format(err);
   }
 };
 
 } // namespace windows
 
-#define CALF_WIN32_WSA_CHECK(result, func) if (!(result)) calf::platform::windows::debugging::wsa_check(L#result, L#func, __FILEW__, __LINE__)
-#define CALF_WIN32_WSA_ASSERT(result, func) if (!(result)) calf::platform::windows::debugging::wsa_check(L#result, L#func, __FILEW__, __LINE__)
+#define CALF_WIN32_WSA_CHECK(result, func) if (!(result)) calf::platform::windows::debugging::wsa_check(L#result, L#func, CALF_LOG_FILE, __LINE__)
+#define CALF_WIN32_WSA_ASSERT(result, func) if (!(result)) calf::platform::windows::debugging::wsa_check(L#result, L#func, CALF_LOG_FILE, __LINE__)
 
 class winsock {
 public:
@@ -91,6 +91,8 @@ struct socket_context
   }
 
   WSABUF wsabuf;
+  // 不为空时按切片一次 WSASend 发送，完成后消费已发送的字节。
+  buffer_chain chain;
   SOCKADDR_IN local_addr;
   SOCKADDR_IN remote_addr;
 };
@@ -211,14 +213,28 @@ public:
 
   void send(socket_context& context) {
     context.type = io_type::write;
-    context.wsabuf.buf = reinterpret_cast<CHAR*>(context.buffer.data());
-    context.wsabuf.len = context.buffer.size();
+
+    // WSABUF 数组只在调用期间使用，切片内容由 context.chain 持有到发送完成。
+    std::vector<WSABUF> buffers;
+    if (context.chain.empty()) {
+      context.wsabuf.buf = reinterpret_cast<CHAR*>(context.buffer.data());
+      context.wsabuf.len = context.buffer.size();
+      buffers.push_back(context.wsabuf);
+    } else {
+      buffers.reserve(context.chain.slice_count());
+      for (auto& slice : context.chain) {
+        WSABUF buffer;
+        buffer.buf = reinterpret_cast<CHAR*>(const_cast<std::uint8_t*>(slice.data()));
+        buffer.len = static_cast<ULONG>(slice.size);
+        buffers.push_back(buffer);
+      }
+    }
 
     DWORD bytes_sent = 0;
     int result = ::WSASend(
         socket_,
-        &context.wsabuf,
-        1,
+        buffers.data(),
+        static_cast<DWORD>(buffers.size()),
         &bytes_sent,
         0,
         &context.overlapped,
@@ -339,7 +355,11 @@ private:
         break;
       case io_type::write:
         sc->is_pending = false;
-        sc->buffer.resize(sc->bytes_transferred);
+        if (sc->chain.empty()) {
+          sc->buffer.resize(sc->bytes_transferred);
+        } else {
+          sc->chain.consume(sc->bytes_transferred);
+        }
         break;
       case io_type::read:
         sc->is_pending = false;
@@ -480,12 +500,7 @@ public:
   void connect(const std::wstring& addr) {
     socket_.bind(L"0.0.0.0");
 
-    // 初始连接就可以发送数据了。 
-    std::unique_lock<std::mutex> lock(send_mutex_);
-    send_context_.buffer.swap(send_buffer_);
-    send_buffer_.clear();
-    lock.unlock();
-
+    // 连接前追加的数据在连接完成后发送。
     socket_.connect(addr, send_context_, std::bind(&socket_channel::connect_completed, this));
   }
 
@@ -500,12 +515,7 @@ public:
 
   void send_buffer(const std::uint8_t* data, std::size_t size) {
     std::unique_lock<std::mutex> lock(send_mutex_);
-
-    std::size_t offset = send_buffer_.size();
-    CALF_WIN32_CHECK(offset + size < socket::max_buffer_size);
-
-    send_buffer_.resize(offset + size);
-    memcpy(send_buffer_.data() + offset, data, size);
+    send_buffer_.append(data, size);
     lock.unlock();
 
     send();
@@ -515,25 +525,29 @@ public:
     send_buffer(reinterpret_cast<const std::uint8_t*>(data.c_str()), data.size());
   }
 
-  // 直接使用 io_buffer 可以利用移动语义交换缓存区，性能较好。
+  // 直接使用 io_buffer 可以利用移动语义接管缓存区，不拷贝内容，性能较好。
   // 推荐使用。
   void send_buffer(io_buffer& buffer) {
     std::unique_lock<std::mutex> lock(send_mutex_);
+    send_buffer_.append(std::move(buffer));
+    lock.unlock();
 
-    std::size_t offset = send_buffer_.size();
-    if (offset == 0) {
-      send_buffer_.swap(buffer);
-    } else {
-      CALF_WIN32_CHECK(offset + buffer.size() < socket::max_buffer_size);
+    send();
+  }
 
-      send_buffer_.resize(offset + buffer.size());
-      memcpy(send_buffer_.data() + offset, buffer.data(), buffer.size());
-    }
+  // 按引用发送共享的缓存区，同一份数据可以发给多个连接，发送完之前不能修改。
+  void send_buffer(const shared_buffer& buffer, std::size_t offset, std::size_t size) {
+    std::unique_lock<std::mutex> lock(send_mutex_);
+    send_buffer_.append(buffer, offset, size);
     lock.unlock();
 
     send();
   }
 
+  void send_buffer(const shared_buffer& buffer) {
+    send_buffer(buffer, 0, buffer->size());
+  }
+
   io_buffer recv_buffer() {
     std::unique_lock<std::mutex> lock(recv_mutex_);
     io_buffer buffer;
@@ -588,15 +602,15 @@ private:
       return;
     }
 
-    // 发送缓存区中的数据，直接交换 buffer 即可。
+    // 发送缓存区中的数据，直接交换切片链即可。
     std::unique_lock<std::mutex> lock(send_mutex_);
 
-    if (send_buffer_.empty()) {
+    // 上一次发送的剩余部分由 send_completed 继续发送。
+    if (send_buffer_.empty() || !send_context_.chain.empty()) {
       return;
     }
 
-    send_context_.buffer.swap(send_buffer_);
-    send_buffer_.clear();
+    send_context_.chain.swap(send_buffer_);
     lock.unlock();
 
     socket_.send(send_context_, std::bind(&socket_channel::send_completed, this));
@@ -607,6 +621,11 @@ private:
       closed();
       return;
     }
+    // 只发送了一部分，先把剩余的切片发完。
+    if (!send_context_.chain.empty()) {
+      socket_.send(send_context_, std::bind(&socket_channel::send_completed, this));
+      return;
+    }
     send();
   }
 
@@ -620,6 +639,8 @@ private:
 
   void recv_completed() {
     if (recv_context_.type != io_type::read) {
+      // 对端异常时可能频繁触发，限制输出频率。
+      CALF_LOG_RATE(warn, 10) << L"socket channel receive broken.";
       closed();
       return;
     }
@@ -654,7 +675,7 @@ private:
 private:
   socket socket_;
   std::atomic_bool connected_flag_;
-  io_buffer send_buffer_;
+  buffer_chain send_buffer_;
   io_buffer recv_buffer_;
   std::mutex send_mutex_;
   std::mutex recv_mutex_;
@@ -282,6 +282,8 @@ public:
 
   void receive_completed() {
     if (read_context_.type != io_type::read) {
+      // 对端异常时可能频繁触发，限制输出频率。
+      CALF_LOG_RATE(warn, 10) << L"pipe message channel receive broken.";
       closed();
       return;
     }
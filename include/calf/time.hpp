@@ -0,0 +1,350 @@
+// 时间模块。
+//
+// - tsc_clock    基于 TSC 的时钟，启动时以 CLOCK_MONOTONIC/CLOCK_REALTIME 校准，之后每秒重新同步一次，
+//                读取只需几个纳秒。
+//                TSC 不可用或不恒定时退化为 steady_clock。
+// - coarse_now   粗粒度时钟，精度为内核 tick，读取开销最小。
+// - loop_clock   每轮事件循环缓存一次的当前时间，由 io_multiplexing_service、worker_service
+//                等循环更新，同一轮中的日志、超时和统计读取缓存值即可。
+//
+// 所有时间单位为纳秒。now 为单调时间，realtime 为自 Unix 纪元起的墙上时间。
+//
+#ifndef CALF_TIME_HPP_
+#define CALF_TIME_HPP_
+
+#include "singleton.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define CALF_TIME_HAS_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(__linux__)
+#include <time.h>
+#endif
+
+namespace calf {
+namespace time {
+
+// 系统单调时钟。
+inline std::uint64_t monotonic_ns() {
+#if defined(__linux__)
+  timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#else
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// 系统墙上时钟。
+inline std::uint64_t realtime_ns() {
+#if defined(__linux__)
+  timespec ts;
+  ::clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#else
+  return static_cast<std::uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// 粗粒度单调时钟，Linux 下走 vDSO 且不读硬件计数器。
+inline std::uint64_t coarse_now() {
+#if defined(__linux__)
+  timespec ts;
+  ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#else
+  return monotonic_ns();
+#endif
+}
+
+inline std::uint64_t coarse_realtime() {
+#if defined(__linux__)
+  timespec ts;
+  ::clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+#else
+  return realtime_ns();
+#endif
+}
+
+class tsc_clock : public singleton<tsc_clock> {
+public:
+  // 启动时的校准时长，越长越精确。
+  static const std::uint64_t calibration_ns = 5 * 1000 * 1000;
+  // 重新同步的间隔。以系统时钟为基准重新估计 TSC 频率，并更新墙上时间的偏移，跟随 NTP 的调整。
+  static const std::uint64_t resync_ns = 1000 * 1000 * 1000;
+
+public:
+  tsc_clock()
+    : use_tsc_(false),
+      current_(0),
+      realtime_offset_(0),
+      resync_at_(0),
+      sync_tsc_(0),
+      sync_monotonic_(0) {
+    calibrate();
+  }
+
+  // 单调时间。
+  std::uint64_t now() const {
+#ifdef CALF_TIME_HAS_TSC
+    if (use_tsc_) {
+      std::uint64_t tsc = read_tsc();
+      std::uint64_t resync_at = resync_at_.load(std::memory_order_relaxed);
+      if (tsc >= resync_at) {
+        resync(resync_at);
+      }
+      return convert(tsc);
+    }
+#endif
+    std::uint64_t value = monotonic_ns();
+    std::uint64_t resync_at = resync_at_.load(std::memory_order_relaxed);
+    if (value >= resync_at) {
+      resync(resync_at);
+    }
+    return value;
+  }
+
+  // 墙上时间。两次同步之间与单调时间同步前进，同步时跟随系统时间的调整，系统时间被回拨时可能倒退。
+  std::uint64_t realtime() const {
+    std::uint64_t value = now();
+    return value + realtime_offset();
+  }
+
+  // 墙上时间与单调时间的差值。
+  std::uint64_t realtime_offset() const {
+    return realtime_offset_.load(std::memory_order_relaxed);
+  }
+
+  bool is_tsc() const { return use_tsc_; }
+
+  // 重新校准。非线程安全，应在启动阶段调用，之后由 now() 定期重新同步。
+  void calibrate() {
+    realtime_offset_.store(realtime_ns() - monotonic_ns(), std::memory_order_relaxed);
+    use_tsc_ = false;
+    resync_at_.store(monotonic_ns() + resync_ns, std::memory_order_relaxed);
+#ifdef CALF_TIME_HAS_TSC
+    if (!has_invariant_tsc()) {
+      return;
+    }
+
+    std::uint64_t tsc_begin = 0;
+    std::uint64_t monotonic_begin = sample(&tsc_begin);
+    std::uint64_t tsc_end = 0;
+    std::uint64_t monotonic_end = monotonic_begin;
+    while (monotonic_end - monotonic_begin < calibration_ns) {
+      monotonic_end = sample(&tsc_end);
+    }
+    if (tsc_end <= tsc_begin) {
+      return;
+    }
+
+    double ns_per_tick = static_cast<double>(monotonic_end - monotonic_begin) /
+        static_cast<double>(tsc_end - tsc_begin);
+    publish(tsc_end, monotonic_end, ns_per_tick);
+    sync_tsc_ = tsc_end;
+    sync_monotonic_ = monotonic_end;
+    resync_at_.store(tsc_end + static_cast<std::uint64_t>(resync_ns / ns_per_tick), std::memory_order_relaxed);
+    use_tsc_ = true;
+#endif
+  }
+
+private:
+  // 一组校准参数，sequence 为奇数时表示正在写入。
+  struct calibration {
+    calibration()
+      : sequence(0),
+        tsc_base(0),
+        monotonic_base(0),
+        ns_per_tick(0) {}
+
+    std::atomic<std::uint32_t> sequence;
+    std::atomic<std::uint64_t> tsc_base;
+    std::atomic<std::uint64_t> monotonic_base;
+    std::atomic<double> ns_per_tick;
+  };
+
+  // 读到的时间超过 resync_at_ 的线程把它改为最大值，抢到的线程负责同步，其它线程直接跳过。
+  // 只采样两次系统时钟，不会像启动校准那样等待。
+  void resync(std::uint64_t resync_at) const {
+    if (!resync_at_.compare_exchange_strong(
+        resync_at, std::numeric_limits<std::uint64_t>::max(), std::memory_order_acquire)) {
+      return;
+    }
+
+#ifdef CALF_TIME_HAS_TSC
+    if (use_tsc_) {
+      std::uint64_t tsc = 0;
+      std::uint64_t monotonic = sample(&tsc);
+      std::uint64_t realtime = realtime_ns();
+      double ns_per_tick = static_cast<double>(monotonic - sync_monotonic_) /
+          static_cast<double>(tsc - sync_tsc_);
+      std::uint64_t estimate = convert(tsc);
+      if (estimate > monotonic) {
+        // 已经超前时不能回退，从当前值继续，并在下一个间隔内放慢追平系统时钟。
+        std::uint64_t ahead = estimate - monotonic;
+        if (ahead > resync_ns / 2) {
+          ahead = resync_ns / 2;
+        }
+        publish(tsc, estimate, ns_per_tick * static_cast<double>(resync_ns - ahead) / resync_ns);
+      } else {
+        publish(tsc, monotonic, ns_per_tick);
+      }
+      realtime_offset_.store(realtime - monotonic, std::memory_order_relaxed);
+      sync_tsc_ = tsc;
+      sync_monotonic_ = monotonic;
+      resync_at_.store(tsc + static_cast<std::uint64_t>(resync_ns / ns_per_tick),
+          std::memory_order_release);
+      return;
+    }
+#endif
+    std::uint64_t monotonic = monotonic_ns();
+    realtime_offset_.store(realtime_ns() - monotonic, std::memory_order_relaxed);
+    resync_at_.store(monotonic + resync_ns, std::memory_order_release);
+  }
+
+#ifdef CALF_TIME_HAS_TSC
+  static std::uint64_t read_tsc() {
+    return __rdtsc();
+  }
+
+  // 写入当前未使用的一组参数后切换，读取方不会等待写入方。
+  void publish(std::uint64_t tsc_base, std::uint64_t monotonic_base, double ns_per_tick) const {
+    std::uint32_t next = current_.load(std::memory_order_relaxed) ^ 1;
+    calibration& value = calibrations_[next];
+    std::uint32_t sequence = value.sequence.load(std::memory_order_relaxed);
+    value.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    value.tsc_base.store(tsc_base, std::memory_order_relaxed);
+    value.monotonic_base.store(monotonic_base, std::memory_order_relaxed);
+    value.ns_per_tick.store(ns_per_tick, std::memory_order_relaxed);
+    value.sequence.store(sequence + 2, std::memory_order_release);
+    current_.store(next, std::memory_order_release);
+  }
+
+  // 读取期间参数被改写时重试。其它核上读取的 TSC 可能略早于刚更新的基准，按基准处理。
+  std::uint64_t convert(std::uint64_t tsc) const {
+    for (;;) {
+      const calibration& value = calibrations_[current_.load(std::memory_order_acquire)];
+      std::uint32_t sequence = value.sequence.load(std::memory_order_acquire);
+      std::uint64_t tsc_base = value.tsc_base.load(std::memory_order_relaxed);
+      std::uint64_t monotonic_base = value.monotonic_base.load(std::memory_order_relaxed);
+      double ns_per_tick = value.ns_per_tick.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if ((sequence & 1) == 0 && value.sequence.load(std::memory_order_relaxed) == sequence) {
+        std::uint64_t ticks = tsc > tsc_base ? tsc - tsc_base : 0;
+        return monotonic_base + static_cast<std::uint64_t>(ticks * ns_per_tick);
+      }
+    }
+  }
+
+  // 在两次单调时钟读取之间读取 TSC，取中点减小误差。
+  static std::uint64_t sample(std::uint64_t* tsc) {
+    std::uint64_t before = monotonic_ns();
+    *tsc = read_tsc();
+    std::uint64_t after = monotonic_ns();
+    return before + (after - before) / 2;
+  }
+
+  // CPUID.80000007H:EDX[8]，TSC 频率恒定且不受 C/P 状态影响。
+  static bool has_invariant_tsc() {
+#if defined(_MSC_VER)
+    int regs[4] = { 0 };
+    __cpuid(regs, 0x80000000);
+    if (static_cast<unsigned int>(regs[0]) < 0x80000007u) {
+      return false;
+    }
+    __cpuid(regs, 0x80000007);
+    return (regs[3] & (1 << 8)) != 0;
+#else
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007u) {
+      return false;
+    }
+    __cpuid(0x80000007, eax, ebx, ecx, edx);
+    return (edx & (1u << 8)) != 0;
+#endif
+  }
+#endif
+
+private:
+  bool use_tsc_;
+  // 两组校准参数轮流使用，current_ 为正在使用的一组。
+  mutable calibration calibrations_[2];
+  mutable std::atomic<std::uint32_t> current_;
+  mutable std::atomic<std::uint64_t> realtime_offset_;
+  // 下次同步的时间，使用 TSC 时为 TSC 计数，否则为单调时间；正在同步时为最大值。
+  mutable std::atomic<std::uint64_t> resync_at_;
+  // 上次同步时的采样，只由抢到同步的线程访问。
+  mutable std::uint64_t sync_tsc_;
+  mutable std::uint64_t sync_monotonic_;
+};
+
+inline std::uint64_t now() {
+  return tsc_clock::instance()->now();
+}
+
+inline std::uint64_t realtime() {
+  return tsc_clock::instance()->realtime();
+}
+
+// 每轮事件循环缓存一次的时间，缓存是线程局部的。
+// 没有运行事件循环的线程读取时直接返回 tsc_clock 的时间。
+class loop_clock {
+public:
+  // 由事件循环在每轮开始时调用。
+  static void update() {
+    cached() = tsc_clock::instance()->now();
+  }
+
+  // 事件循环退出时调用，之后该线程恢复读取实时时间。
+  static void reset() {
+    cached() = 0;
+  }
+
+  static std::uint64_t now() {
+    std::uint64_t value = cached();
+    return value != 0 ? value : tsc_clock::instance()->now();
+  }
+
+  static std::uint64_t realtime() {
+    std::uint64_t value = cached();
+    tsc_clock* clock = tsc_clock::instance();
+    return (value != 0 ? value : clock->now()) + clock->realtime_offset();
+  }
+
+private:
+  static std::uint64_t& cached() {
+    thread_local std::uint64_t value = 0;
+    return value;
+  }
+};
+
+inline std::uint64_t cached_now() {
+  return loop_clock::now();
+}
+
+inline std::uint64_t cached_realtime() {
+  return loop_clock::realtime();
+}
+
+} // namespace time
+} // namespace calf
+
+#endif // CALF_TIME_HPP_
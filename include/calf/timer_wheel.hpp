@@ -0,0 +1,322 @@
+// 分层时间轮。
+//
+// 5 层时间轮，第一层 256 个槽，其余每层 64 个槽，以 tick 为单位覆盖 2^32 个 tick，
+// 默认 tick 为 1 毫秒，约 49 天，更远的定时器放在最高层最后一个槽中，到期前重新分配。
+// 插入和取消都是 O(1)：定时器节点以侵入式双向链表挂在槽上，节点来自空闲链表，不逐个分配。
+//
+// 时间轮本身不是线程安全的，由所属事件循环线程使用。
+//
+#ifndef CALF_TIMER_WHEEL_HPP_
+#define CALF_TIMER_WHEEL_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace calf {
+
+class timer_wheel {
+public:
+  using task_t = std::function<void(void)>;
+
+  static const int levels = 5;
+  static const int root_bits = 8;
+  static const int level_bits = 6;
+  static const std::uint64_t root_size = 1ull << root_bits;
+  static const std::uint64_t level_size = 1ull << level_bits;
+  static const std::uint64_t max_ticks = 1ull << (root_bits + level_bits * (levels - 1));
+  // 每次扩充的节点数。
+  static const std::size_t node_block_size = 1024;
+
+private:
+  struct link {
+    link* prev;
+    link* next;
+  };
+
+  struct node : link {
+    std::uint64_t expires;
+    std::uint64_t interval;
+    std::uint64_t generation;
+    task_t task;
+  };
+
+public:
+  // 定时器句柄，定时器到期或取消后句柄自动失效，重复取消是安全的。
+  struct timer_id {
+    timer_id() : timer(nullptr), generation(0) {}
+    timer_id(node* n, std::uint64_t g) : timer(n), generation(g) {}
+
+    bool is_valid() const { return timer != nullptr; }
+
+    node* timer;
+    std::uint64_t generation;
+  };
+
+public:
+  // tick_ns 为时间轮精度，start_ns 为起始时间。
+  explicit timer_wheel(std::uint64_t tick_ns = 1000000, std::uint64_t start_ns = 0)
+    : tick_ns_(tick_ns),
+      current_(start_ns / tick_ns),
+      count_(0),
+      free_(nullptr),
+      running_(nullptr) {
+    for (int level = 0; level < levels; ++level) {
+      std::size_t size = level == 0 ? root_size : level_size;
+      slots_[level].resize(size);
+      for (auto& slot : slots_[level]) {
+        reset(&slot);
+      }
+    }
+    root_bitmap_.assign(root_size / 64, 0);
+  }
+
+  timer_wheel(const timer_wheel&) = delete;
+  timer_wheel& operator=(const timer_wheel&) = delete;
+
+  // 在绝对时间 expires_ns 到期，interval_ns 不为 0 时周期触发。
+  timer_id schedule(std::uint64_t expires_ns, std::uint64_t interval_ns, task_t task) {
+    node* n = allocate();
+    // 向上取整，保证不会早于指定时间触发。
+    n->expires = (expires_ns + tick_ns_ - 1) / tick_ns_;
+    if (n->expires <= current_) {
+      n->expires = current_ + 1;
+    }
+    n->interval = interval_ns == 0 ? 0 : std::max<std::uint64_t>(1, (interval_ns + tick_ns_ - 1) / tick_ns_);
+    n->task = std::move(task);
+    insert(n);
+    ++count_;
+    return timer_id(n, n->generation);
+  }
+
+  // 取消定时器，返回定时器是否仍然有效。可以在定时器回调中取消自己。
+  bool cancel(const timer_id& id) {
+    node* n = id.timer;
+    if (n == nullptr || n->generation != id.generation) {
+      return false;
+    }
+    if (n == running_) {
+      // 正在执行的周期定时器，执行完后不再重新插入。
+      n->interval = 0;
+      ++n->generation;
+      return true;
+    }
+    unlink(n);
+    --count_;
+    release(n);
+    return true;
+  }
+
+  // 推进到 now_ns，执行所有到期的定时器，返回执行的数量。
+  std::size_t advance(std::uint64_t now_ns) {
+    std::uint64_t target = now_ns / tick_ns_;
+    if (count_ == 0) {
+      if (target > current_) {
+        current_ = target;
+      }
+      return 0;
+    }
+
+    // 跳过第一层的空槽，长时间没有推进时也只在层间迁移处停下。
+    std::size_t fired = 0;
+    while (current_ < target) {
+      std::uint64_t ticks = next_ticks();
+      if (current_ + ticks > target) {
+        current_ = target;
+        break;
+      }
+      current_ += ticks;
+      std::uint64_t index = current_ & (root_size - 1);
+      if (index == 0) {
+        cascade();
+      }
+      fired += expire(index);
+      if (count_ == 0) {
+        current_ = target;
+        break;
+      }
+    }
+    return fired;
+  }
+
+  // 距离下一次需要推进的时间，单位纳秒，没有定时器时返回 -1。
+  // 第一层中没有到期的定时器时返回到下一次层间迁移的时间，届时重新计算。
+  std::int64_t next_timeout(std::uint64_t now_ns) const {
+    if (count_ == 0) {
+      return -1;
+    }
+    std::uint64_t expires_ns = (current_ + next_ticks()) * tick_ns_;
+    return expires_ns > now_ns ? static_cast<std::int64_t>(expires_ns - now_ns) : 0;
+  }
+
+  std::size_t size() const { return count_; }
+  std::uint64_t get_tick_ns() const { return tick_ns_; }
+
+private:
+  static int count_trailing_zeros(std::uint64_t value) {
+#if defined(_MSC_VER)
+    unsigned long index = 0;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(value);
+#endif
+  }
+
+  // 到第一层下一个非空槽的 tick 数，没有时为到下一次层间迁移的 tick 数。
+  std::uint64_t next_ticks() const {
+    std::uint64_t index = current_ & (root_size - 1);
+    for (std::uint64_t i = index + 1; i < root_size; ) {
+      std::uint64_t word = root_bitmap_[i / 64] >> (i % 64);
+      if (word != 0) {
+        return i + count_trailing_zeros(word) - index;
+      }
+      i = (i / 64 + 1) * 64;
+    }
+    return root_size - index;
+  }
+
+  static void reset(link* head) {
+    head->prev = head->next = head;
+  }
+
+  static void push_back(link* head, link* n) {
+    n->prev = head->prev;
+    n->next = head;
+    head->prev->next = n;
+    head->prev = n;
+  }
+
+  static void unlink(link* n) {
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+    n->prev = n->next = nullptr;
+  }
+
+  // 把 from 整条链表移到 to，from 清空。
+  static void splice(link* from, link* to) {
+    reset(to);
+    if (from->next != from) {
+      to->next = from->next;
+      to->prev = from->prev;
+      to->next->prev = to;
+      to->prev->next = to;
+      reset(from);
+    }
+  }
+
+  void insert(node* n) {
+    // 超出范围的定时器先放在最高层最远的位置，expires 保持不变，迁移到第一层后再重新分配。
+    std::uint64_t expires = std::min(n->expires, current_ + max_ticks - 1);
+    std::uint64_t delta = expires - current_;
+    int level = 0;
+    std::uint64_t index = 0;
+    if (delta < root_size) {
+      index = expires & (root_size - 1);
+      root_bitmap_[index / 64] |= 1ull << (index % 64);
+    } else {
+      level = 1;
+      while (level < levels - 1 && delta >= (root_size << (level_bits * level))) {
+        ++level;
+      }
+      index = (expires >> (root_bits + level_bits * (level - 1))) & (level_size - 1);
+    }
+    push_back(&slots_[level][index], n);
+  }
+
+  // 第一层转完一圈，把上层的定时器迁移下来。
+  void cascade() {
+    for (int level = 1; level < levels; ++level) {
+      std::uint64_t index = (current_ >> (root_bits + level_bits * (level - 1))) & (level_size - 1);
+      link pending;
+      splice(&slots_[level][index], &pending);
+      while (pending.next != &pending) {
+        node* n = static_cast<node*>(pending.next);
+        unlink(n);
+        insert(n);
+      }
+      if (index != 0) {
+        break;
+      }
+    }
+  }
+
+  std::size_t expire(std::uint64_t index) {
+    root_bitmap_[index / 64] &= ~(1ull << (index % 64));
+    link* slot = &slots_[0][index];
+    if (slot->next == slot) {
+      return 0;
+    }
+
+    // 先摘下整条链表，回调中插入同一个槽的定时器留到下一圈，回调中取消的定时器直接从 pending 中摘除。
+    link pending;
+    splice(slot, &pending);
+
+    std::size_t fired = 0;
+    while (pending.next != &pending) {
+      node* n = static_cast<node*>(pending.next);
+      unlink(n);
+      if (n->expires > current_) {
+        insert(n);
+        continue;
+      }
+
+      running_ = n;
+      std::uint64_t generation = n->generation;
+      n->task();
+      running_ = nullptr;
+      ++fired;
+
+      if (n->interval != 0 && n->generation == generation) {
+        n->expires = current_ + n->interval;
+        insert(n);
+      } else {
+        --count_;
+        release(n);
+      }
+    }
+    return fired;
+  }
+
+  node* allocate() {
+    if (free_ == nullptr) {
+      blocks_.emplace_back(new node[node_block_size]);
+      node* block = blocks_.back().get();
+      for (std::size_t i = 0; i < node_block_size; ++i) {
+        block[i].generation = 0;
+        block[i].next = free_;
+        free_ = &block[i];
+      }
+    }
+    node* n = static_cast<node*>(free_);
+    free_ = n->next;
+    n->prev = n->next = nullptr;
+    n->interval = 0;
+    return n;
+  }
+
+  void release(node* n) {
+    ++n->generation;
+    n->task = nullptr;
+    n->prev = nullptr;
+    n->next = free_;
+    free_ = n;
+  }
+
+private:
+  std::uint64_t tick_ns_;
+  std::uint64_t current_;
+  std::size_t count_;
+  std::vector<link> slots_[levels];
+  // 第一层非空槽的位图，用于计算下一次到期时间。
+  std::vector<std::uint64_t> root_bitmap_;
+  std::vector<std::unique_ptr<node[]>> blocks_;
+  link* free_;
+  node* running_;
+};
+
+} // namespace calf
+
+#endif // CALF_TIMER_WHEEL_HPP_
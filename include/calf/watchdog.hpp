@@ -0,0 +1,242 @@
+// 事件循环卡顿检测。
+//
+// 每个事件循环持有一个 loop_heartbeat，执行处理者或任务前记录开始时间和名称，执行完清零。
+// watchdog 线程定期检查被监视的心跳，某次执行超过阈值时输出名称、已执行时长，
+// Linux 下同时抓取卡住的线程的调用栈。没有被监视的心跳只多一次原子读。
+//
+#ifndef CALF_WATCHDOG_HPP_
+#define CALF_WATCHDOG_HPP_
+
+#include "logging.hpp"
+#include "time.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include "platform/linux/debugging.hpp"
+#endif
+
+namespace calf {
+
+class loop_heartbeat {
+public:
+  loop_heartbeat()
+    : watched_(false),
+      attached_(false),
+      busy_since_(0),
+      name_(nullptr) {}
+
+  loop_heartbeat(const loop_heartbeat&) = delete;
+  loop_heartbeat& operator=(const loop_heartbeat&) = delete;
+
+  bool is_watched() const {
+    return watched_.load(std::memory_order_relaxed);
+  }
+
+  // 由事件循环线程在进入和退出循环时调用，用于抓取调用栈。
+  void attach() {
+#if defined(__linux__)
+    thread_ = ::pthread_self();
+#endif
+    attached_.store(true, std::memory_order_release);
+  }
+
+  void detach() {
+    attached_.store(false, std::memory_order_release);
+    end();
+  }
+
+  // name 必须是静态存储的字符串，例如 typeid(...).name()。
+  void begin(const char* name) {
+    name_.store(name, std::memory_order_relaxed);
+    busy_since_.store(time::now(), std::memory_order_release);
+  }
+
+  void end() {
+    busy_since_.store(0, std::memory_order_release);
+  }
+
+private:
+  friend class watchdog;
+
+  std::atomic_bool watched_;
+  std::atomic_bool attached_;
+  // 正在执行的处理者的开始时间，空闲时为 0。
+  std::atomic<std::uint64_t> busy_since_;
+  std::atomic<const char*> name_;
+#if defined(__linux__)
+  pthread_t thread_;
+#endif
+};
+
+struct watchdog_options {
+  // 单次执行超过该时长时报告。
+  std::chrono::milliseconds threshold = std::chrono::milliseconds(100);
+  // 检查间隔。
+  std::chrono::milliseconds interval = std::chrono::milliseconds(10);
+  // 报告时抓取卡住的线程的调用栈，仅 Linux 支持。
+  bool capture_stack = true;
+};
+
+// 监视线程，每次卡顿只报告一次。
+// 被监视的心跳必须在 watchdog 停止或 unwatch 之后才能析构。
+class watchdog {
+public:
+  struct report {
+    std::string loop;
+    std::string handler;
+    std::uint64_t elapsed_ns;
+    std::string stack;
+  };
+
+  using report_handler = std::function<void(const report&)>;
+
+public:
+  explicit watchdog(const watchdog_options& options = watchdog_options())
+    : options_(options),
+      quit_flag_(false),
+      report_count_(0) {}
+
+  ~watchdog() {
+    stop();
+  }
+
+  watchdog(const watchdog&) = delete;
+  watchdog& operator=(const watchdog&) = delete;
+
+  // 开始监视一个事件循环，name 用于报告。
+  void watch(const std::string& name, loop_heartbeat& heartbeat) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry item;
+    item.name = name;
+    item.heartbeat = &heartbeat;
+    item.reported = 0;
+    entries_.push_back(item);
+    heartbeat.watched_.store(true, std::memory_order_relaxed);
+  }
+
+  void unwatch(loop_heartbeat& heartbeat) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->heartbeat == &heartbeat) {
+        heartbeat.watched_.store(false, std::memory_order_relaxed);
+        entries_.erase(it);
+        break;
+      }
+    }
+  }
+
+  // 默认输出警告日志，设置后改为调用 handler。handler 在监视线程中持锁执行，不能再调用 watch/unwatch。
+  void set_report_handler(const report_handler& handler) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    handler_ = handler;
+  }
+
+  void start() {
+    if (thread_.joinable()) {
+      return;
+    }
+    quit_flag_ = false;
+    thread_ = std::thread(&watchdog::run_loop, this);
+  }
+
+  void stop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    quit_flag_ = true;
+    lock.unlock();
+    cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  std::uint64_t get_report_count() const {
+    return report_count_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct entry {
+    std::string name;
+    loop_heartbeat* heartbeat;
+    // 已经报告过的那次执行的开始时间。
+    std::uint64_t reported;
+  };
+
+  void run_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!quit_flag_) {
+      cv_.wait_for(lock, options_.interval, [this]() { return quit_flag_; });
+      if (quit_flag_) {
+        break;
+      }
+      check();
+    }
+  }
+
+  void check() {
+    std::uint64_t threshold_ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(options_.threshold).count());
+    std::uint64_t now = time::now();
+    for (auto& item : entries_) {
+      loop_heartbeat* heartbeat = item.heartbeat;
+      std::uint64_t since = heartbeat->busy_since_.load(std::memory_order_acquire);
+      if (since == 0 || since == item.reported || now < since || now - since < threshold_ns) {
+        continue;
+      }
+      item.reported = since;
+
+      report value;
+      value.loop = item.name;
+      const char* name = heartbeat->name_.load(std::memory_order_relaxed);
+      value.handler = name != nullptr ? demangle(name) : std::string();
+      value.elapsed_ns = now - since;
+#if defined(__linux__)
+      // 抓取时目标线程仍在同一次执行中，调用栈才有意义。
+      if (options_.capture_stack && heartbeat->attached_.load(std::memory_order_acquire)) {
+        value.stack = platform::linux::thread_stack::capture(heartbeat->thread_);
+        if (heartbeat->busy_since_.load(std::memory_order_acquire) != since) {
+          value.stack.clear();
+        }
+      }
+#endif
+      report_count_.fetch_add(1, std::memory_order_relaxed);
+      if (handler_) {
+        handler_(value);
+      } else {
+        CALF_LOG(warn) << "event loop " << value.loop << " stalled in " << value.handler
+            << " for " << value.elapsed_ns / 1000000 << "ms"
+            << (value.stack.empty() ? "" : "\n") << value.stack;
+      }
+    }
+  }
+
+  static std::string demangle(const char* name) {
+#if defined(__linux__)
+    return platform::linux::thread_stack::demangle(name);
+#else
+    return name;
+#endif
+  }
+
+private:
+  watchdog_options options_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool quit_flag_;
+  std::vector<entry> entries_;
+  report_handler handler_;
+  std::atomic<std::uint64_t> report_count_;
+};
+
+} // namespace calf
+
+#endif // CALF_WATCHDOG_HPP_
\ No newline at end of file
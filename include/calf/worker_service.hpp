@@ -1,6 +1,9 @@
 #ifndef CALF_WORKER_SERVICE_HPP
 #define CALF_WORKER_SERVICE_HPP
 
+#include "time.hpp"
+#include "watchdog.hpp"
+
 #include <atomic>
 #include <condition_variable>
 #include <functional>
@@ -9,6 +12,7 @@
 #include <mutex>
 #include <queue>
 #include <type_traits>
+#include <typeinfo>
 
 
 namespace calf {
@@ -25,6 +29,7 @@ public:
   }
 
   void run_loop() {
+    heartbeat_.attach();
     while (!quit_flag_.load(std::memory_order_acquire)) {
       std::unique_lock<std::mutex> lock(mutex_);
       cv_.wait(lock, [this]() -> bool {
@@ -32,6 +37,8 @@ public:
       });
       do_work(lock);
     }
+    heartbeat_.detach();
+    time::loop_clock::reset();
   }
 
   void run_one() {
@@ -44,6 +51,11 @@ public:
     cv_.notify_all();
   }
 
+  // 交给 calf::watchdog 监视，任务执行过久时报告。
+  loop_heartbeat& get_heartbeat() {
+    return heartbeat_;
+  }
+
   template<typename Fn, 
       typename ...Args,
       typename Ret = typename std::result_of<Fn>::type>
@@ -74,7 +86,14 @@ private:
       task_t task = task_queue_.front();
       task_queue_.pop_front();
       lock.unlock();
-      task();
+      time::loop_clock::update();
+      if (heartbeat_.is_watched()) {
+        heartbeat_.begin(task.target_type().name());
+        task();
+        heartbeat_.end();
+      } else {
+        task();
+      }
       lock.lock();
     }
   }
@@ -84,6 +103,7 @@ private:
   std::condition_variable cv_;
   std::mutex mutex_;
   std::atomic_bool quit_flag_;
+  loop_heartbeat heartbeat_;
 };
 
 } // namespace calf
@@ -1,5 +1,49 @@
+#include <calf/platform/linux/file_io.hpp>
+
+#include <cstdio>
 #include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+
+using namespace calf::platform::linux;
+
+// IO 线程没有运行时关闭 file_channel，之后再启动 file_io_service，
+// 关闭前投递的 flush 任务不能再访问已经析构的通道。
+bool close_with_service_stopped(const std::string& path) {
+  file_io_service service;
+  {
+    file_channel_options options;
+    options.truncate = true;
+    file_channel channel(path, service, file_channel::file_handler(), options);
+    channel.write(std::string(1000, 'a'));
+    channel.write(std::string(24, 'b'));
+    channel.close();
+    if (channel.get_written_bytes() != 1024) {
+      return false;
+    }
+  }
+  service.start();
+  service.stop();
+
+  service.start();
+  {
+    file_channel channel(path, service);
+    channel.write(std::string(10, 'c'));
+    if (!channel.sync().get()) {
+      return false;
+    }
+  }
+  service.stop();
+
+  struct stat st;
+  return ::stat(path.c_str(), &st) == 0 && st.st_size == 1034;
+}
 
 int main(int argc, char* argv[]) {
-  std::cout << "tst" << std::endl;
-}
\ No newline at end of file
+  std::string path = argc > 1 ? argv[1] : "/tmp/calf_linux_sample.bin";
+  bool ok = close_with_service_stopped(path);
+  std::remove(path.c_str());
+  std::cout << "close with service stopped: " << (ok ? "ok" : "failed") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+// 日志性能基准。
+//
+// 对每种输出目标和生产者线程数，测量 CALF_LOG 调用点的耗时分布、整体吞吐和每条记录的内存分配次数，
+// 写入 log_file_target 的目标（file、binary、async）同时报告写入文件的字节数和 MB/s。
+// 结果按 JSON lines 输出到标准输出，便于比较不同版本：
+//   {"target":"file","threads":4,"records":200000,"ns_per_op":...,"p50":...,"p99":...,"p999":...}
+//
+// 用法：log_bench [records] [targets] [threads] [dir]
+//   records  每轮记录总数，默认 200000，由各线程平分
+//   targets  逗号分隔，默认 stdout,file,async,binary,ring
+//   threads  逗号分隔，默认 1,2,4,8,16,32,64
+//   dir      日志文件目录，默认 /tmp
+//
+// 测量期间标准输出被重定向到 /dev/null，stdout 目标只计算格式化和写入的开销。
+//
+#include <calf/logging.hpp>
+#include <calf/async_logging.hpp>
+#include <calf/time.hpp>
+#include <calf/platform/linux/file_io.hpp>
+#include <calf/platform/linux/log_ring.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// 分配计数，调用点按线程统计，全局计数包括后台线程。
+namespace {
+
+std::atomic<std::uint64_t> total_allocations(0);
+thread_local std::uint64_t thread_allocations = 0;
+
+} // namespace
+
+namespace {
+
+void* counted_malloc(std::size_t size) noexcept {
+  total_allocations.fetch_add(1, std::memory_order_relaxed);
+  ++thread_allocations;
+  return std::malloc(size != 0 ? size : 1);
+}
+
+void* counted_new(std::size_t size) {
+  void* p = counted_malloc(size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+// 不内联，否则 GCC 会把内联后的 free 与调用方的 new 配对，报 -Wmismatched-new-delete。
+__attribute__((noinline)) void counted_free(void* p) noexcept {
+  std::free(p);
+}
+
+} // namespace
+
+// 替换全部非对齐的 new/delete，成对使用 malloc/free。对齐版本保持标准库实现，不计数。
+void* operator new(std::size_t size) {
+  return counted_new(size);
+}
+
+void* operator new[](std::size_t size) {
+  return counted_new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  return counted_malloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+  return counted_malloc(size);
+}
+
+void operator delete(void* p) noexcept {
+  counted_free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  counted_free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  counted_free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+  counted_free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept {
+  counted_free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept {
+  counted_free(p);
+}
+
+namespace {
+
+using calf::logging::log_manager;
+using calf::logging::log_target;
+using calf::logging::log_format;
+
+struct bench_result {
+  std::string target;
+  std::size_t threads;
+  std::size_t records;
+  double elapsed_ns;
+  double ns_per_op;
+  double records_per_second;
+  std::uint64_t bytes;
+  double mb_per_second;
+  std::uint64_t p50;
+  std::uint64_t p99;
+  std::uint64_t p999;
+  std::uint64_t max;
+  double allocs_per_record;
+  double total_allocs_per_record;
+};
+
+std::vector<std::string> split(const std::string& str) {
+  std::vector<std::string> items;
+  std::stringstream stream(str);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
+  }
+  return items;
+}
+
+using calf::platform::linux::logging::log_file_target;
+
+// file_target 返回最终写文件的 log_file_target，用于统计写入字节数，其它目标为空。
+std::unique_ptr<log_target> make_target(
+    const std::string& name,
+    const std::string& dir,
+    log_file_target*& file_target) {
+  using calf::platform::linux::logging::log_file_options;
+  using calf::platform::linux::logging::log_ring_target;
+
+  file_target = nullptr;
+  if (name == "stdout") {
+    return std::make_unique<calf::logging::log_stdout_target>();
+  }
+  if (name == "file") {
+    auto target = std::make_unique<log_file_target>(dir + "/log_bench.log");
+    file_target = target.get();
+    return target;
+  }
+  if (name == "binary") {
+    log_file_options options;
+    options.format = log_format::binary;
+    auto target = std::make_unique<log_file_target>(dir + "/log_bench.bin", options);
+    file_target = target.get();
+    return target;
+  }
+  if (name == "async") {
+    auto target = std::make_unique<log_file_target>(dir + "/log_bench_async.log");
+    file_target = target.get();
+    return std::make_unique<calf::logging::log_async_target>(std::move(target));
+  }
+  if (name == "ring") {
+    return std::make_unique<log_ring_target>(dir + "/log_bench.ring");
+  }
+  return nullptr;
+}
+
+std::uint64_t percentile(const std::vector<std::uint64_t>& sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  std::size_t index = static_cast<std::size_t>(p * (sorted.size() - 1));
+  return sorted[index];
+}
+
+bench_result run(
+    const std::string& name,
+    log_target* target,
+    log_file_target* file_target,
+    std::size_t threads,
+    std::size_t records) {
+  std::size_t per_thread = std::max<std::size_t>(records / threads, 1);
+  std::vector<std::vector<std::uint64_t>> samples(threads);
+  std::vector<std::uint64_t> allocations(threads, 0);
+  for (auto& thread_samples : samples) {
+    thread_samples.resize(per_thread);
+  }
+
+  std::atomic<std::size_t> ready(0);
+  std::atomic_bool start(false);
+  std::vector<std::thread> producers;
+  for (std::size_t t = 0; t < threads; ++t) {
+    producers.emplace_back([&, t]() {
+      std::vector<std::uint64_t>& thread_samples = samples[t];
+      ready.fetch_add(1);
+      while (!start.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+
+      std::uint64_t base = thread_allocations;
+      for (std::size_t i = 0; i < per_thread; ++i) {
+        std::uint64_t begin = calf::time::now();
+        CALF_LOG(info).kv("thread", t).kv("seq", i) << "benchmark record " << i << ' ' << 3.25;
+        thread_samples[i] = calf::time::now() - begin;
+      }
+      allocations[t] = thread_allocations - base;
+    });
+  }
+
+  while (ready.load() != threads) {
+    std::this_thread::yield();
+  }
+  std::uint64_t base_allocations = total_allocations.load();
+  std::uint64_t base_bytes = file_target != nullptr ? file_target->get_stats().total_bytes : 0;
+  std::uint64_t begin = calf::time::now();
+  start.store(true, std::memory_order_release);
+  for (auto& producer : producers) {
+    producer.join();
+  }
+  target->sync();
+  std::uint64_t elapsed = calf::time::now() - begin;
+  std::uint64_t run_allocations = total_allocations.load() - base_allocations;
+  std::uint64_t bytes = file_target != nullptr ? file_target->get_stats().total_bytes - base_bytes : 0;
+
+  std::vector<std::uint64_t> all;
+  all.reserve(per_thread * threads);
+  std::uint64_t call_allocations = 0;
+  for (std::size_t t = 0; t < threads; ++t) {
+    all.insert(all.end(), samples[t].begin(), samples[t].end());
+    call_allocations += allocations[t];
+  }
+  std::sort(all.begin(), all.end());
+  std::uint64_t sum = 0;
+  for (auto sample : all) {
+    sum += sample;
+  }
+
+  bench_result result;
+  result.target = name;
+  result.threads = threads;
+  result.records = all.size();
+  result.elapsed_ns = static_cast<double>(elapsed);
+  result.ns_per_op = static_cast<double>(sum) / all.size();
+  result.records_per_second = all.size() * 1e9 / static_cast<double>(elapsed);
+  result.bytes = bytes;
+  result.mb_per_second = bytes * 1e3 / static_cast<double>(elapsed);
+  result.p50 = percentile(all, 0.50);
+  result.p99 = percentile(all, 0.99);
+  result.p999 = percentile(all, 0.999);
+  result.max = all.back();
+  result.allocs_per_record = static_cast<double>(call_allocations) / all.size();
+  result.total_allocs_per_record = static_cast<double>(run_allocations) / all.size();
+  return result;
+}
+
+void print(std::FILE* out, const bench_result& result) {
+  std::fprintf(out,
+      "{\"target\":\"%s\",\"threads\":%zu,\"records\":%zu,\"elapsed_ns\":%.0f,"
+      "\"ns_per_op\":%.1f,\"records_per_second\":%.0f,"
+      "\"bytes\":%llu,\"mb_per_second\":%.1f,"
+      "\"p50\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu,"
+      "\"allocs_per_record\":%.2f,\"total_allocs_per_record\":%.2f}\n",
+      result.target.c_str(), result.threads, result.records, result.elapsed_ns,
+      result.ns_per_op, result.records_per_second,
+      static_cast<unsigned long long>(result.bytes), result.mb_per_second,
+      static_cast<unsigned long long>(result.p50),
+      static_cast<unsigned long long>(result.p99),
+      static_cast<unsigned long long>(result.p999),
+      static_cast<unsigned long long>(result.max),
+      result.allocs_per_record, result.total_allocs_per_record);
+  std::fflush(out);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+  std::size_t records = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+  std::vector<std::string> targets = split(argc > 2 ? argv[2] : "stdout,file,async,binary,ring");
+  std::vector<std::string> thread_counts = split(argc > 3 ? argv[3] : "1,2,4,8,16,32,64");
+  std::string dir = argc > 4 ? argv[4] : "/tmp";
+  if (records == 0) {
+    records = 200000;
+  }
+
+  // 结果写到原来的标准输出，日志输出丢弃。
+  std::FILE* out = ::fdopen(::dup(STDOUT_FILENO), "w");
+  int null_fd = ::open("/dev/null", O_WRONLY);
+  if (out == nullptr || null_fd < 0) {
+    std::perror("log_bench");
+    return 1;
+  }
+  ::dup2(null_fd, STDOUT_FILENO);
+  ::close(null_fd);
+
+  calf::time::tsc_clock::instance();
+  log_manager* manager = log_manager::instance();
+  for (auto& name : targets) {
+    std::string target_name = "bench_" + name;
+    log_file_target* file_target = nullptr;
+    std::unique_ptr<log_target> target = make_target(name, dir, file_target);
+    if (target == nullptr) {
+      std::fprintf(stderr, "unknown target: %s\n", name.c_str());
+      continue;
+    }
+    log_target* raw_target = target.get();
+    manager->add_target(target_name.c_str(), std::move(target));
+    manager->set_default_target(target_name.c_str());
+
+    for (auto& count : thread_counts) {
+      std::size_t threads = std::strtoul(count.c_str(), nullptr, 10);
+      if (threads == 0) {
+        continue;
+      }
+      print(out, run(name, raw_target, file_target, threads, records));
+    }
+  }
+  std::fclose(out);
+  return 0;
+}
@@ -0,0 +1,29 @@
+// 从 log_ring_target 的环文件中取出最后的日志记录。
+//
+// 用法：log_recover <ring file> [count]
+// 记录按写入顺序原样输出到标准输出，count 为 0 或省略时输出全部。
+//
+#include <calf/platform/linux/log_ring.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <ring file> [count]" << std::endl;
+    return 2;
+  }
+
+  calf::platform::linux::logging::log_ring_reader reader;
+  if (!reader.open(argv[1])) {
+    std::cerr << "invalid log ring file: " << argv[1] << std::endl;
+    return 1;
+  }
+
+  std::size_t count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+  for (auto& record : reader.tail(count)) {
+    std::fwrite(record.data(), 1, record.size(), stdout);
+  }
+  return 0;
+}